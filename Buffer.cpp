@@ -6,7 +6,7 @@
 #include "Buffer.hpp"
 
 Buffer::Chunk::Chunk() : start(0), end(0) { mlock(this, sizeof(*this)); }
-Buffer::Buffer() : _size(0) { mlock(this, sizeof(*this)); }
+Buffer::Buffer() : _size(0), _historySize(0), historyLimit(0) { mlock(this, sizeof(*this)); }
 
 void Buffer::resize_smaller(size_t newSize) {
 	assert(newSize <= _size);
@@ -32,7 +32,7 @@ void Buffer::resize_smaller(size_t newSize) {
 	assert(newSize == 0);
 }
 
-size_t Buffer::pop(uint8_t* target, size_t target_size, bool doCleanup) {
+size_t Buffer::_pop(uint8_t* target, size_t target_size, bool doCleanup) {
 	size_t c = 0;
 	for(Chunk& chunk : chunks) {
 		Chunk::Idx chunkEnd = chunk.end;
@@ -43,10 +43,13 @@ size_t Buffer::pop(uint8_t* target, size_t target_size, bool doCleanup) {
 		int s = chunkEnd - chunk.start;
 		if(s == 0) continue;
 		if((size_t)s > target_size) s = (int)target_size;
-		memcpy(target, chunk.data + chunk.start, s);
+		if(target) {
+			memcpy(target, chunk.data + chunk.start, s);
+			target += s;
+		}
 		chunk.start += s;
 		_size -= s;
-		target += s;
+		_historySize += s;
 		target_size -= s;
 		c += s;
 		if(chunk.start < chunkEnd) {
@@ -61,12 +64,44 @@ size_t Buffer::pop(uint8_t* target, size_t target_size, bool doCleanup) {
 		assert(chunkEnd == Chunk::BufferSize());
 
 		// This can be heavy (the `free`ing), so we might want to do it elsewhere.
-		if(doCleanup)
+		// Note that this is not necessarily this chunk but the oldest history chunk.
+		if(doCleanup && _historySize >= historyLimit + Chunk::BufferSize()) {
 			chunks.pop_front();
+			_historySize -= Chunk::BufferSize();
+		}
 	}
 	return c;
 }
 
+size_t Buffer::pop(uint8_t* target, size_t target_size, bool doCleanup) {
+	return _pop(target, target_size, doCleanup);
+}
+
+size_t Buffer::skip(size_t size, bool doCleanup) {
+	return _pop(NULL, size, doCleanup);
+}
+
+size_t Buffer::rewind(size_t size) {
+	size = std::min(size, (size_t)_historySize);
+	// All chunks before the read position are fully consumed.
+	// We keep newStart bytes of the history, counted from the oldest chunk.
+	size_t newStart = _historySize - size;
+	for(Chunk& chunk : chunks) {
+		Chunk::Idx start = chunk.start;
+		if(start == 0) break;
+		if(newStart >= start) {
+			newStart -= start;
+			continue;
+		}
+		size_t s = start - newStart;
+		chunk.start = (Chunk::Idx) newStart;
+		_historySize -= s;
+		_size += s;
+		newStart = 0;
+	}
+	return size;
+}
+
 void Buffer::push(const uint8_t* data, size_t size) {
 	while(size > 0) {
 		auto chunkBackPtr = chunks.back();
@@ -93,6 +128,8 @@ void Buffer::cleanup() {
 		Chunk& chunk = chunkPtr->value;
 		if(chunk.end < Chunk::BufferSize()) break;
 		if(chunk.size() > 0) break;
+		if(_historySize < historyLimit + Chunk::BufferSize()) break;
 		chunks.pop_front();
+		_historySize -= Chunk::BufferSize();
 	}
 }
@@ -21,12 +21,16 @@ struct Buffer {
 	};
 	LinkedList<Chunk> chunks;
 	std::atomic<size_t> _size;
+	// Already popped data which is kept resident, so that we can rewind().
+	// cleanup() drops the oldest chunks if it gets bigger than historyLimit.
+	std::atomic<size_t> _historySize;
+	std::atomic<size_t> historyLimit;
 
 	Buffer();
 	
 	// these are all not multithreading safe
 	size_t size() { return _size; }
-	void clear() { _size = 0; chunks.clear(); }
+	void clear() { _size = 0; _historySize = 0; chunks.clear(); }
 	bool empty() { return size() == 0; }
 	void resize_smaller(size_t newSize);
 
@@ -34,10 +38,24 @@ struct Buffer {
 	// single consumer supported
 	size_t pop(uint8_t* target, size_t target_size, bool doCleanup = true);
 
+	// like pop() but just drops the data
+	// single consumer supported
+	size_t skip(size_t size, bool doCleanup = true);
+
+	// moves the read position back into the history, see historySize().
+	// returns amount of data restored, i.e. <= size.
+	// not safe with a concurrent pop() or cleanup()
+	size_t rewind(size_t size);
+	size_t historySize() { return _historySize; }
+
 	// single producer supported
 	void push(const uint8_t* data, size_t size);
 	
 	void cleanup();
+
+private:
+	// target can be NULL
+	size_t _pop(uint8_t* target, size_t target_size, bool doCleanup);
 };
 
 #endif // BUFFER_HPP
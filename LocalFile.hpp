@@ -0,0 +1,20 @@
+#ifndef MP_LOCALFILE_HPP
+#define MP_LOCALFILE_HPP
+
+#include <stdint.h>
+#include <string>
+
+// A local file which PlayerInStream reads directly instead of via
+// song.readPacket/seekRaw, see PlayerObject::fileIo.
+// The interface is like the AVIOContext callbacks (see initIoCtx()).
+struct LocalFile {
+	virtual ~LocalFile() {}
+	// Fails if it is not a regular file.
+	virtual bool open(const std::string& filename) = 0;
+	// Returns 0 at EOF, -1 on error.
+	virtual int read(uint8_t* buf, int size) = 0;
+	// whence is SEEK_SET, SEEK_CUR, SEEK_END or AVSEEK_SIZE.
+	virtual int64_t seek(int64_t offset, int whence) = 0;
+};
+
+#endif // MP_LOCALFILE_HPP
@@ -0,0 +1,146 @@
+
+// must be first include because of Python stuff, see musicplayer.h comment
+#include "PyThreading.hpp"
+
+#include "LockProfiler.hpp"
+#include "musicplayer.h"
+#include "PythonHelpers.h"
+#include "Py3Compat.h"
+#include <map>
+#include <mutex>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+
+#define LOCKPROFILER_BUCKETS	24 // log2 of microseconds, like PlayerStats
+
+std::atomic<bool> lockProfilerEnabled(false);
+
+namespace {
+
+struct WaitKey {
+	LockWaitKind kind;
+	const char* name;
+	void* site;
+	void* holder;
+	bool operator<(const WaitKey& o) const {
+		return std::tie(kind, name, site, holder) < std::tie(o.kind, o.name, o.site, o.holder);
+	}
+};
+
+struct WaitEntry {
+	uint64_t count;
+	double totalSecs, maxSecs;
+	uint64_t histogram[LOCKPROFILER_BUCKETS];
+	WaitEntry() : count(0), totalSecs(0), maxSecs(0) {
+		for(int i = 0; i < LOCKPROFILER_BUCKETS; ++i) histogram[i] = 0;
+	}
+};
+
+}
+
+// Not a PyMutex, because that one is profiled itself.
+static std::mutex& waitsMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+static std::map<WaitKey, WaitEntry>& waits() {
+	static std::map<WaitKey, WaitEntry> m;
+	return m;
+}
+
+void lockProfilerRecord(LockWaitKind kind, const char* name, void* site, void* holder, double waitSecs) {
+	uint64_t us = waitSecs > 0 ? uint64_t(waitSecs * 1000000) : 0;
+	int bucket = 0;
+	while(us > 0 && bucket < LOCKPROFILER_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	WaitKey key = {kind, name, site, holder};
+	std::lock_guard<std::mutex> lock(waitsMutex());
+	WaitEntry& entry = waits()[key];
+	entry.count++;
+	entry.totalSecs += waitSecs;
+	entry.maxSecs = std::max(entry.maxSecs, waitSecs);
+	entry.histogram[bucket]++;
+}
+
+void LockProfilerSpinWait::begin() {
+	startTime = monotonicTime();
+	site = getStackPtr(1);
+}
+
+void LockProfilerSpinWait::record() {
+	lockProfilerRecord(LockWait_Spin, name, site, NULL, monotonicTime() - startTime);
+	startTime = 0;
+}
+
+static const char* kindName(LockWaitKind kind) {
+	switch(kind) {
+	case LockWait_Mutex: return "mutex";
+	case LockWait_GIL: return "gil";
+	case LockWait_Spin: return "spin";
+	}
+	return "?";
+}
+
+PyObject* pyEnableLockProfiler(PyObject* self, PyObject* args) {
+	int enable = 1;
+	if(!PyArg_ParseTuple(args, "|i:enableLockProfiler", &enable))
+		return NULL;
+	lockProfilerEnabled = enable != 0;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyObject* pyGetLockProfile(PyObject* self, PyObject* args, PyObject* kws) {
+	int limit = 20;
+	int reset = 0;
+	static const char *kwlist[] = {"limit", "reset", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kws, "|ii:getLockProfile", (char**)kwlist, &limit, &reset))
+		return NULL;
+
+	std::vector<std::pair<WaitKey, WaitEntry> > entries;
+	{
+		std::lock_guard<std::mutex> lock(waitsMutex());
+		entries.assign(waits().begin(), waits().end());
+		if(reset) waits().clear();
+	}
+	// The worst offenders first.
+	std::sort(entries.begin(), entries.end(),
+			  [](const std::pair<WaitKey, WaitEntry>& a, const std::pair<WaitKey, WaitEntry>& b) {
+				  return a.second.totalSecs > b.second.totalSecs;
+			  });
+	if(limit >= 0 && (size_t) limit < entries.size())
+		entries.resize(limit);
+
+	PyObject* l = PyList_New(entries.size());
+	if(!l) return NULL;
+	for(size_t i = 0; i < entries.size(); ++i) {
+		const WaitKey& key = entries[i].first;
+		const WaitEntry& entry = entries[i].second;
+		PyObject* d = PyDict_New();
+		if(!d) {
+			Py_DECREF(l);
+			return NULL;
+		}
+		PyDict_SetItemString_retain(d, "kind", PyString_FromString(kindName(key.kind)));
+		if(key.name)
+			PyDict_SetItemString_retain(d, "name", PyString_FromString(key.name));
+		PyDict_SetItemString_retain(d, "site", PyString_FromString(key.site ? getStackSymbol(key.site).c_str() : "?"));
+		if(key.kind == LockWait_Mutex)
+			PyDict_SetItemString_retain(d, "holder", PyString_FromString(key.holder ? getStackSymbol(key.holder).c_str() : "?"));
+		PyDict_SetItemString_retain(d, "count", PyLong_FromUnsignedLongLong(entry.count));
+		PyDict_SetItemString_retain(d, "totalSecs", PyFloat_FromDouble(entry.totalSecs));
+		PyDict_SetItemString_retain(d, "maxSecs", PyFloat_FromDouble(entry.maxSecs));
+		PyObject* histogram = PyList_New(LOCKPROFILER_BUCKETS);
+		if(histogram) {
+			for(int j = 0; j < LOCKPROFILER_BUCKETS; ++j)
+				PyList_SET_ITEM(histogram, j, PyLong_FromUnsignedLongLong(entry.histogram[j]));
+			PyDict_SetItemString_retain(d, "histogram", histogram);
+		}
+		PyList_SET_ITEM(l, i, d);
+	}
+	return l;
+}
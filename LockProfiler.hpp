@@ -0,0 +1,42 @@
+#ifndef MP_LOCKPROFILER_HPP
+#define MP_LOCKPROFILER_HPP
+
+#include <atomic>
+
+// Optional instrumentation of the waits in PyMutex::lock(), PyScopedGIL and
+// our spin-wait loops (pyQueueLock, openStreamLock, outStreamOpening).
+// Disabled by default. Then it costs a relaxed atomic load per lock.
+// When enabled, each wait is recorded per call site (and for PyMutex, per call
+// site of the holder) into a histogram. See musicplayer.getLockProfile().
+
+// GIL acquisitions which were faster are not recorded, see PyScopedGIL::ensureProfiled().
+#define LOCKPROFILER_GIL_MIN_WAIT_SECS	0.00005
+
+enum LockWaitKind {
+	LockWait_Mutex,
+	LockWait_GIL,
+	LockWait_Spin,
+};
+
+extern std::atomic<bool> lockProfilerEnabled;
+
+// site and holder are code addresses, see getStackPtr(). name is for the spin waits.
+void lockProfilerRecord(LockWaitKind kind, const char* name, void* site, void* holder, double waitSecs);
+
+// For the spin-wait loops:
+//   LockProfilerSpinWait spinWait("pyQueueLock");
+//   while(pyQueueLock) { spinWait.spin(); ... }
+//   spinWait.finish(); // or at the end of the scope
+struct LockProfilerSpinWait {
+	const char* name;
+	double startTime; // 0 if we didn't wait (yet)
+	void* site;
+	LockProfilerSpinWait(const char* _name) : name(_name), startTime(0), site(0) {}
+	~LockProfilerSpinWait() { finish(); }
+	void spin() { if(startTime == 0 && lockProfilerEnabled.load(std::memory_order_relaxed)) begin(); }
+	void begin();
+	void finish() { if(startTime > 0) record(); }
+	void record();
+};
+
+#endif // MP_LOCKPROFILER_HPP
@@ -0,0 +1,98 @@
+
+#include "MmapFile.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h> // AVSEEK_*
+}
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+MmapFile::MmapFile() : fd(-1), data(NULL), size(0), pos(0), willNeedEnd(0), dontNeedEnd(0) {}
+
+MmapFile::~MmapFile() {
+	close();
+}
+
+bool MmapFile::open(const std::string& filename) {
+	close();
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+	struct stat st;
+	// Empty files cannot be mapped. Let the caller fall back.
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+		close();
+		return false;
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED) {
+		close();
+		return false;
+	}
+	data = (uint8_t*) p;
+	size = st.st_size;
+	pos = willNeedEnd = dontNeedEnd = 0;
+	madvise(data, size, MADV_SEQUENTIAL);
+	adviseAround();
+	return true;
+}
+
+void MmapFile::close() {
+	if(data) munmap(data, size);
+	data = NULL;
+	size = 0;
+	if(fd >= 0) ::close(fd);
+	fd = -1;
+}
+
+void MmapFile::adviseAround() {
+	static const size_t pageSize = sysconf(_SC_PAGESIZE);
+	// Call it only once per half window, madvise() is a syscall.
+	bool ahead = willNeedEnd < size && pos + MMAPFILE_WILLNEED_SIZE / 2 >= willNeedEnd;
+	bool seekedBack = pos + MMAPFILE_WILLNEED_SIZE < willNeedEnd;
+	if(ahead || seekedBack) {
+		size_t start = pos - pos % pageSize;
+		size_t end = std::min(size, pos + MMAPFILE_WILLNEED_SIZE);
+		if(end > start)
+			madvise(data + start, end - start, MADV_WILLNEED);
+		willNeedEnd = end;
+	}
+	if(pos > MMAPFILE_KEEP_BEHIND * 2) {
+		size_t end = pos - MMAPFILE_KEEP_BEHIND;
+		end -= end % pageSize;
+		if(end > dontNeedEnd + MMAPFILE_KEEP_BEHIND) {
+			madvise(data + dontNeedEnd, end - dontNeedEnd, MADV_DONTNEED);
+			dontNeedEnd = end;
+		}
+	}
+	if(pos < dontNeedEnd) // seeked back
+		dontNeedEnd = pos - pos % pageSize;
+}
+
+int MmapFile::read(uint8_t* buf, int bufSize) {
+	if(!data) return -1;
+	if(pos >= size) return 0;
+	size_t n = std::min((size_t) bufSize, size - pos);
+	memcpy(buf, data + pos, n);
+	pos += n;
+	adviseAround();
+	return (int) n;
+}
+
+int64_t MmapFile::seek(int64_t offset, int whence) {
+	if(!data) return -1;
+	if(whence == AVSEEK_SIZE) return size;
+	whence &= ~AVSEEK_FORCE;
+	int64_t newPos = -1;
+	if(whence == SEEK_SET) newPos = offset;
+	else if(whence == SEEK_CUR) newPos = pos + offset;
+	else if(whence == SEEK_END) newPos = size + offset;
+	if(newPos < 0) return -1;
+	pos = newPos;
+	adviseAround();
+	return pos;
+}
@@ -0,0 +1,35 @@
+#ifndef MP_MMAPFILE_HPP
+#define MP_MMAPFILE_HPP
+
+#include "LocalFile.hpp"
+#include <stddef.h>
+
+#define MMAPFILE_WILLNEED_SIZE	(1024 * 1024) // how much ahead of the read position we let the kernel fetch
+#define MMAPFILE_KEEP_BEHIND	(1024 * 1024 * 4) // we drop the pages further behind the read position
+
+// Maps the whole file. read() copies straight from the mapping, so there is
+// no syscall and no Python bytes object per read. The madvise() hints follow
+// the read position: sequential access, WILLNEED ahead, DONTNEED far behind.
+// Note: If the file is truncated while we have it mapped, reading it gives SIGBUS.
+// Not multithreading safe.
+struct MmapFile : LocalFile {
+	MmapFile();
+	~MmapFile();
+	bool open(const std::string& filename);
+	void close();
+
+	int read(uint8_t* buf, int size);
+	int64_t seek(int64_t offset, int whence);
+
+private:
+	int fd;
+	uint8_t* data;
+	size_t size;
+	size_t pos;
+	size_t willNeedEnd; // up to where we already called madvise(WILLNEED)
+	size_t dontNeedEnd; // up to where we already called madvise(DONTNEED)
+
+	void adviseAround();
+};
+
+#endif // MP_MMAPFILE_HPP
@@ -0,0 +1,55 @@
+
+// must be first include because of Python stuff, see musicplayer.h comment
+#include "PyThreading.hpp"
+
+#include "PacketQueue.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+PacketQueue::PacketQueue() : count(0), bytes(0), duration(0), wakeup(NULL) {}
+
+PacketQueue::~PacketQueue() {
+	flush();
+}
+
+void PacketQueue::push(AVPacket* pkt, double pktDuration) {
+	Entry entry;
+	entry.pkt = *pkt;
+	entry.duration = pktDuration > 0 ? pktDuration : 0;
+	PyScopedLock lock(mutex);
+	entries.push_back(entry);
+	count = entries.size();
+	bytes = bytes + pkt->size;
+	duration = duration + entry.duration;
+}
+
+bool PacketQueue::pop(AVPacket* pkt) {
+	bool wasFull;
+	{
+		PyScopedLock lock(mutex);
+		if(entries.empty()) return false;
+		wasFull = full();
+		Entry& entry = entries.front();
+		*pkt = entry.pkt;
+		bytes = bytes - pkt->size;
+		duration = entries.size() > 1 ? duration - entry.duration : 0; // avoid rounding drift
+		entries.pop_front();
+		count = entries.size();
+	}
+	// Otherwise, the demux thread is busy with us anyway.
+	if(wakeup && (wasFull || empty()))
+		wakeup->notify();
+	return true;
+}
+
+void PacketQueue::flush() {
+	PyScopedLock lock(mutex);
+	for(Entry& entry : entries)
+		av_free_packet(&entry.pkt);
+	entries.clear();
+	count = 0;
+	bytes = 0;
+	duration = 0;
+}
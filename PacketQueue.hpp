@@ -0,0 +1,45 @@
+#ifndef MP_PACKETQUEUE_HPP
+#define MP_PACKETQUEUE_HPP
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "PyThreading.hpp"
+#include <deque>
+#include <atomic>
+
+#define PACKETQUEUE_MAX_SECS	10 // how much we demux ahead
+#define PACKETQUEUE_MAX_BYTES	(1024 * 1024) // in case the packets don't have a duration
+
+// Demuxed packets which wait for the decoder, similar to ffplay.
+// The demux thread pushes, audio_decode_frame() pops.
+// Multithreading safe. The queue owns the packets.
+struct PacketQueue {
+	struct Entry {
+		AVPacket pkt;
+		double duration; // in secs, 0 if unknown
+	};
+
+	PyMutex mutex;
+	std::deque<Entry> entries;
+	std::atomic<size_t> count;
+	std::atomic<size_t> bytes;
+	std::atomic<double> duration;
+	PyWakeup* wakeup; // notified when pop() makes room, i.e. the demux thread can go on
+
+	PacketQueue();
+	~PacketQueue();
+
+	// Takes over the packet data.
+	void push(AVPacket* pkt, double duration);
+	// The caller owns the packet then. Returns false if empty.
+	bool pop(AVPacket* pkt);
+	void flush();
+	bool full() const {
+		return duration >= PACKETQUEUE_MAX_SECS || bytes >= PACKETQUEUE_MAX_BYTES;
+	}
+	bool empty() const { return count == 0; }
+};
+
+#endif // MP_PACKETQUEUE_HPP
@@ -14,7 +14,11 @@ extern "C" {
 #include "PyUtils.h"
 #include "PyThreading.hpp"
 #include "Buffer.hpp"
+#include "SeekIndex.hpp"
+#include "PacketQueue.hpp"
+#include "LocalFile.hpp"
 #include <atomic>
+#include <memory>
 
 struct PlayerObject;
 
@@ -58,12 +62,37 @@ struct PlayerInStream : PlayerInStreamRawPOD {
 	// PlayerObject::lock must be unlocked before locking this!
 	PyMutex lock;
 
+	std::string url; // song.url, also the key to match peek songs
+	std::unique_ptr<LocalFile> file; // if we read the local file directly, see PlayerObject::fileIo
 	std::string debugName;
 	Buffer outBuffer;
 	bool readerHitEnd; // this will be set by audio_decode_frame()
 	bool playerStartedPlaying; // this would be set by readOutStream()
 	bool playerHitEnd; // this would be set by readOutStream()
 	std::atomic<double> playerTimePos;
+	size_t skipOutBytes; // decoded data to drop before outBuffer, see seekInBuffer()
+	SeekIndex seekIndex;
+	bool useSeekIndex; // if the container has no own index
+	bool seekIndexTrusted; // if readerTimePos is exact, also without pts
+	// Decoded audio time per wall time of _processInStream(). 0 if unknown yet.
+	// This includes the reading only when the packets queue ran empty,
+	// otherwise the demux thread hides it. See demuxSpeed for that part.
+	// Set by the worker, used by readOutStream() for the pre-roll.
+	std::atomic<double> decodeSpeed;
+	double decodeAudioTime, decodeWallTime; // decaying sums for decodeSpeed
+	std::atomic<double> decodeSecs, resampleSecs; // total, for player.stats
+	// The demux stage, see PlayerObject::demuxThread. It reads the audio packets
+	// ahead into packets, so that the I/O latency is hidden behind the decoding.
+	// Lock order: lock, demuxLock, PlayerObject::lock.
+	PyMutex demuxLock; // covers reading and seeking in ctx
+	PacketQueue packets;
+	std::atomic<bool> demuxReady; // set by open(), until then the demux thread ignores us
+	std::atomic<bool> demuxHitEnd;
+	std::atomic<uint64_t> demuxedPackets, demuxedBytes; // packet statistics
+	std::atomic<double> demuxedSecs;
+	// Demuxed audio time per wall time of the reading. 0 if unknown yet.
+	std::atomic<double> demuxSpeed;
+	double demuxAudioTime, demuxWallTime; // decaying sums for demuxSpeed, covered by demuxLock
 	// The following are delayed actions after fade-out.
 	std::atomic<double> seekPos;
 	std::atomic<bool> skipMe;
@@ -72,6 +101,17 @@ struct PlayerInStream : PlayerInStreamRawPOD {
 		mlock(this, sizeof(*this));
 		memset(this, 0, sizeof(PlayerInStreamRawPOD));
 		playerTimePos = 0;
+		skipOutBytes = 0;
+		useSeekIndex = seekIndexTrusted = false;
+		decodeSpeed = 0;
+		decodeAudioTime = decodeWallTime = 0;
+		decodeSecs = resampleSecs = 0;
+		demuxReady = false;
+		demuxHitEnd = false;
+		demuxedPackets = demuxedBytes = 0;
+		demuxedSecs = 0;
+		demuxSpeed = 0;
+		demuxAudioTime = demuxWallTime = 0;
 		timeLen = -1;
 		readerHitEnd = false;
 		playerStartedPlaying = playerHitEnd = false;
@@ -83,11 +123,32 @@ struct PlayerInStream : PlayerInStreamRawPOD {
 	bool open(PlayerObject* player, PyObject* song);
 	void resetBuffers();
 	void seekAbs(double pos);
+	bool seekInBuffer(double pos);
+	bool seekWithIndex(double pos);
+	void scanSeekIndex(const SeekIndex::Entry& start, double pos);
+	int demuxPacket(AVPacket* pkt);
+	int nextPacket(AVPacket* pkt);
+	bool demuxAhead();
 	
 	bool isOpened() {
 		return ctx != NULL;
 	}
 };
 
+// Opens only the container of a song to get the tags, duration and stream
+// info (codec, bit rate, channels). No audio decoder is opened and no
+// PlayerInStream with its buffers is created. If song is NULL, the file at url
+// is read directly and the GIL is not needed at all.
+// With withCoverArt, the attached pictures are returned as "cover_art",
+// scaled to fit into thumbnailSize x thumbnailSize if thumbnailSize > 0.
+// Returns a new dict, or NULL if it failed. We expect to not hold the GIL.
+PyObject* readSongMetadata(PyObject* song, const std::string& url, bool skipPyExceptions,
+						   bool withCoverArt = false, int thumbnailSize = 0);
+
+// Read-only Python buffer objects which take over FFmpeg owned memory
+// (musicplayer_avbuffer.cpp). We expect to hold the GIL.
+PyObject* newAVBufferFromPacket(AVPacket* pkt);
+PyObject* newAVBufferFromData(uint8_t* data, size_t size);
+
 
 #endif // PLAYERINSTREAM_HPP
@@ -0,0 +1,125 @@
+
+// must be first include because of Python stuff, see musicplayer.h comment
+#include "PyThreading.hpp"
+
+#include "PlayerStats.hpp"
+#include "PythonHelpers.h"
+#include "Py3Compat.h"
+
+
+static thread_local PlayerStats::Thread statsCurThread = PlayerStats::T_Other;
+
+void PlayerStats::setCurThread(Thread t) {
+	statsCurThread = t;
+}
+
+PlayerStats::Thread PlayerStats::curThread() {
+	return statsCurThread;
+}
+
+PlayerStats::Slot::Slot() {
+	for(int c = 0; c < NumCounters; ++c)
+		counters[c] = 0;
+	for(int h = 0; h < NumHistograms; ++h)
+		for(int i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i)
+			histograms[h][i] = 0;
+}
+
+const char* PlayerStats::counterName(Counter c) {
+	switch(c) {
+	case PyReadCalls: return "pyReadCalls";
+	case PyReadBytes: return "pyReadBytes";
+	case DemuxedPackets: return "demuxedPackets";
+	case DemuxedBytes: return "demuxedBytes";
+	case DecodedFrames: return "decodedFrames";
+	case DecodeUs: return "decodeUs";
+	case ResampleUs: return "resampleUs";
+	case ReadOutCalls: return "readOutCalls";
+	case ReadOutSamples: return "readOutSamples";
+	case SilenceSamples: return "silenceSamples";
+	case Underruns: return "underruns";
+	case OutOfSyncEvents: return "outOfSyncEvents";
+	case NumCounters: break;
+	}
+	return "?";
+}
+
+const char* PlayerStats::histogramName(Histogram h) {
+	switch(h) {
+	case ReadOutDuration: return "readOutDuration";
+	case DecodeFrameDuration: return "decodeFrameDuration";
+	case NumHistograms: break;
+	}
+	return "?";
+}
+
+const char* PlayerStats::threadName(Thread t) {
+	switch(t) {
+	case T_Worker: return "worker";
+	case T_Demux: return "demux";
+	case T_PeekDecoder: return "peek decoder";
+	case T_Output: return "output";
+	case T_Other: return "other";
+	case NumThreads: break;
+	}
+	return "?";
+}
+
+void PlayerStats::addToDict(PyObject* dict) {
+	PyObject* totals = PyDict_New();
+	PyObject* threads = PyDict_New();
+	PyObject* histos = PyDict_New();
+	if(!totals || !threads || !histos) {
+		Py_XDECREF(totals);
+		Py_XDECREF(threads);
+		Py_XDECREF(histos);
+		return;
+	}
+
+	for(int c = 0; c < NumCounters; ++c) {
+		uint64_t sum = 0;
+		for(int t = 0; t < NumThreads; ++t)
+			sum += slots[t].counters[c];
+		PyDict_SetItemString_retain(totals, counterName(Counter(c)), PyLong_FromUnsignedLongLong(sum));
+	}
+
+	for(int t = 0; t < NumThreads; ++t) {
+		PyObject* d = PyDict_New();
+		if(!d) continue;
+		for(int c = 0; c < NumCounters; ++c) {
+			uint64_t v = slots[t].counters[c];
+			if(v) PyDict_SetItemString_retain(d, counterName(Counter(c)), PyLong_FromUnsignedLongLong(v));
+		}
+		PyDict_SetItemString_retain(threads, threadName(Thread(t)), d);
+	}
+
+	// Bucket i counts durations < 2^i microseconds (and >= 2^(i-1)).
+	for(int h = 0; h < NumHistograms; ++h) {
+		PyObject* counts = PyList_New(STATS_HISTOGRAM_BUCKETS);
+		if(!counts) continue;
+		for(int i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i) {
+			uint64_t sum = 0;
+			for(int t = 0; t < NumThreads; ++t)
+				sum += slots[t].histograms[h][i];
+			PyList_SET_ITEM(counts, i, PyLong_FromUnsignedLongLong(sum));
+		}
+		PyDict_SetItemString_retain(histos, histogramName(Histogram(h)), counts);
+	}
+
+	PyDict_SetItemString_retain(dict, "counters", totals);
+	PyDict_SetItemString_retain(dict, "threads", threads);
+	PyDict_SetItemString_retain(dict, "histograms", histos);
+}
+
+PlayerStatsTimer::PlayerStatsTimer(PlayerStats& _stats, PlayerStats::Histogram h, PlayerStats::Counter c)
+: stats(_stats), histogram(h), counter(c), startTime(monotonicTime()) {}
+
+double PlayerStatsTimer::finish() {
+	if(startTime == 0) return 0;
+	double secs = monotonicTime() - startTime;
+	startTime = 0;
+	stats.addDuration(histogram, secs);
+	if(counter != PlayerStats::NumCounters)
+		stats.add(counter, uint64_t(secs * 1000000));
+	return secs;
+}
@@ -0,0 +1,93 @@
+#ifndef MP_PLAYERSTATS_HPP
+#define MP_PLAYERSTATS_HPP
+
+#include "PyThreading.hpp" // must be first because of Python, see musicplayer.h
+#include <atomic>
+#include <stdint.h>
+
+#define STATS_HISTOGRAM_BUCKETS	24 // log2 of microseconds, i.e. the last is >= ~8s
+#define STATS_CACHE_LINE_SIZE	64
+
+// Counters and duration histograms of the playback pipeline, see player.stats.
+// Every player thread (worker, demux, audio callback, ...) has its own slot,
+// thus the counters are not shared between CPUs and counting is just a
+// relaxed atomic add. Collecting sums up all slots.
+// The slots are separated by a cache line of padding, so that e.g. the audio
+// callback and the decoder don't write to the same cache line. We don't use
+// alignas(64) because PlayerObject is allocated by Python, with less alignment.
+struct PlayerStats {
+	enum Counter {
+		PyReadCalls, // song.readPacket
+		PyReadBytes,
+		DemuxedPackets,
+		DemuxedBytes,
+		DecodedFrames,
+		DecodeUs, // avcodec_decode_audio4
+		ResampleUs, // swr_convert
+		ReadOutCalls, // readOutStream()
+		ReadOutSamples,
+		SilenceSamples, // filled by readOutStream() because there was no data or we were out of sync
+		Underruns, // readOutStream() had too less data while playing
+		OutOfSyncEvents, // readOutStream() waited for the pre-roll
+		NumCounters
+	};
+	enum Histogram {
+		ReadOutDuration,
+		DecodeFrameDuration,
+		NumHistograms
+	};
+	enum Thread {
+		T_Worker,
+		T_Demux,
+		T_PeekDecoder,
+		T_Output, // audio callback, mixer or sink
+		T_Other, // e.g. Python threads
+		NumThreads
+	};
+
+	struct Slot {
+		char padding[STATS_CACHE_LINE_SIZE];
+		std::atomic<uint64_t> counters[NumCounters];
+		std::atomic<uint64_t> histograms[NumHistograms][STATS_HISTOGRAM_BUCKETS];
+		Slot();
+	};
+	Slot slots[NumThreads];
+	char padding[STATS_CACHE_LINE_SIZE]; // after the last slot
+
+	// Each player thread calls this once at its start.
+	static void setCurThread(Thread t);
+	static Thread curThread();
+
+	void add(Counter c, uint64_t value = 1) {
+		slots[curThread()].counters[c].fetch_add(value, std::memory_order_relaxed);
+	}
+	void addDuration(Histogram h, double secs) {
+		uint64_t us = secs > 0 ? uint64_t(secs * 1000000) : 0;
+		int bucket = 0;
+		while(us > 0 && bucket < STATS_HISTOGRAM_BUCKETS - 1) {
+			us >>= 1;
+			bucket++;
+		}
+		slots[curThread()].histograms[h][bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static const char* counterName(Counter c);
+	static const char* histogramName(Histogram h);
+	static const char* threadName(Thread t);
+
+	// Adds "counters", "threads" and "histograms" to dict. We expect to hold the GIL.
+	void addToDict(PyObject* dict);
+};
+
+// Measures the time of a scope into a histogram and optionally a counter (in microseconds).
+struct PlayerStatsTimer {
+	PlayerStats& stats;
+	PlayerStats::Histogram histogram;
+	PlayerStats::Counter counter;
+	double startTime;
+	PlayerStatsTimer(PlayerStats& _stats, PlayerStats::Histogram h, PlayerStats::Counter c = PlayerStats::NumCounters);
+	~PlayerStatsTimer() { finish(); }
+	double finish(); // returns the secs
+};
+
+#endif // MP_PLAYERSTATS_HPP
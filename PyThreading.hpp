@@ -6,12 +6,16 @@
 #include <atomic>
 #include <functional>
 #include <string>
+#include <mutex>
+#include <condition_variable>
 #include "NonCopyAble.hpp"
+#include "LockProfiler.hpp"
 
 
 struct PyMutex {
 	PyThread_type_lock l;
 	bool enabled;
+	std::atomic<void*> holderSite; // only with lockProfilerEnabled, see getStackPtr()
 	PyMutex(); ~PyMutex();
 	PyMutex(const PyMutex&) : PyMutex() {} // ignore
 	PyMutex& operator=(const PyMutex&) { return *this; } // ignore
@@ -34,7 +38,13 @@ struct PyScopedUnlock : noncopyable {
 
 struct PyScopedGIL : noncopyable {
 	PyGILState_STATE gstate;
-	PyScopedGIL() { gstate = PyGILState_Ensure(); }
+	PyScopedGIL() {
+		if(lockProfilerEnabled.load(std::memory_order_relaxed))
+			ensureProfiled();
+		else
+			gstate = PyGILState_Ensure();
+	}
+	void ensureProfiled();
 	~PyScopedGIL() {
 		if(PyThreadState_Get()->gilstate_counter == 1) {
 			// This means that the thread-state is going to be deleted.
@@ -56,8 +66,20 @@ struct PyScopedGIUnlock : noncopyable {
 };
 
 
+// Lets a thread sleep until there might be something to do, instead of polling.
+// A notify() before the wait() is not lost. Doesn't need the GIL.
+struct PyWakeup : noncopyable {
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool pending;
+	PyWakeup() : pending(false) {}
+	void notify();
+	void wait(double timeoutSecs); // returns also on timeout, as a backstop
+};
+
 struct PyThread : noncopyable {
 	PyMutex lock;
+	PyWakeup wakeup; // for func, also notified by stop()
 	std::atomic<bool> running;
 	std::atomic<bool> stopSignal;
 	std::function<void(std::atomic<bool>& stopSignal)> func;
@@ -76,5 +98,12 @@ int mlock(const void *addr, size_t len);
 
 void setCurThreadName(const std::string& name);
 
+// Code address of the n-th caller (0 is the caller of getStackPtr()), or NULL if not supported.
+void* getStackPtr(int n);
+std::string getStackSymbol(void* pt);
+
+// Monotonic clock, in seconds. Doesn't block, so it is safe in the audio callback.
+double monotonicTime();
+
 
 #endif // PYTHREAD_HPP
@@ -25,6 +25,12 @@ char* objAttrStrDup(PyObject* obj, const char* attrStr);
 std::string objAttrStr(PyObject* obj, const std::string& attrStr);
 std::string objStr(PyObject* obj);
 
+// song.url if it is a non-empty str/bytes, otherwise empty.
+// The url is optional (the song object provides its own IO), and
+// objAttrStr() would give us "<None>" or "None" for a missing one.
+// Takes the GIL itself.
+std::string songUrl(PyObject* song);
+
 // more correct. needs PyGIL
 static inline
 bool pyStr(PyObject* obj, std::string& str) {
@@ -0,0 +1,160 @@
+
+// must be first include because of Python stuff, see musicplayer.h comment
+#include "PyThreading.hpp"
+
+#include "ReadAheadFile.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h> // AVSEEK_*
+}
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+ReadAheadFile::ReadAheadFile()
+: blocksRead(0), readWaits(0), invalidations(0),
+fd(-1), fileSize(-1), pos(0), nextReadOffset(0), generation(0), hitEnd(false), error(false),
+readerWaiting(false), consumerWaiting(false)
+{
+	thread.func = [this](std::atomic<bool>& stopSignal) { readerProc(stopSignal); };
+}
+
+ReadAheadFile::~ReadAheadFile() {
+	close();
+}
+
+bool ReadAheadFile::open(const std::string& filename, PreadFunc func) {
+	close();
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close();
+		return false;
+	}
+	fileSize = st.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	preadFunc = func ? func : PreadFunc(::pread);
+	invalidate(0);
+	thread.start();
+	return true;
+}
+
+void ReadAheadFile::close() {
+	thread.stop();
+	if(fd >= 0) ::close(fd);
+	fd = -1;
+	fileSize = -1;
+	blocks.clear();
+}
+
+void ReadAheadFile::invalidate(int64_t offset) {
+	// We expect to hold the lock (or that the reader thread is not running).
+	blocks.clear();
+	pos = nextReadOffset = offset;
+	generation++;
+	hitEnd = error = false;
+	if(readerWaiting) thread.wakeup.notify();
+}
+
+void ReadAheadFile::readerProc(std::atomic<bool>& stopSignal) {
+	setCurThreadName("musicplayer.so file reader");
+	std::vector<uint8_t> data;
+
+	while(!stopSignal) {
+		int64_t offset;
+		unsigned long gen;
+		{
+			PyScopedLock l(lock);
+			bool full = nextReadOffset - pos >= READAHEAD_BLOCKS * READAHEAD_BLOCK_SIZE;
+			offset = (hitEnd || error || full) ? -1 : nextReadOffset;
+			gen = generation;
+			readerWaiting = offset < 0;
+		}
+		if(offset < 0) {
+			thread.wakeup.wait(READAHEAD_IDLE_WAIT_SECS);
+			continue;
+		}
+
+		// Without the lock, so that read() can go on with the data we have.
+		data.resize(READAHEAD_BLOCK_SIZE);
+		ssize_t ret = preadFunc(fd, &data[0], data.size(), offset);
+
+		PyScopedLock l(lock);
+		if(gen != generation) continue; // we were invalidated meanwhile
+		if(consumerWaiting) dataWakeup.notify(); // whatever happens below, it has to look again
+		if(ret < 0) {
+			error = true;
+			continue;
+		}
+		if(ret == 0) {
+			hitEnd = true;
+			continue;
+		}
+		data.resize(ret);
+		blocks.push_back(Block());
+		blocks.back().offset = offset;
+		blocks.back().data.swap(data);
+		nextReadOffset = offset + ret;
+		blocksRead++;
+		// Release what is behind us.
+		while(blocks.size() > READAHEAD_KEEP_BLOCKS + 1 &&
+			  blocks[READAHEAD_KEEP_BLOCKS].offset + (int64_t) blocks[READAHEAD_KEEP_BLOCKS].data.size() <= pos)
+			blocks.pop_front();
+	}
+}
+
+int ReadAheadFile::read(uint8_t* buf, int size) {
+	if(fd < 0) return -1;
+	bool waited = false;
+	while(true) {
+		{
+			PyScopedLock l(lock);
+			consumerWaiting = false;
+			int64_t windowStart = blocks.empty() ? nextReadOffset : blocks.front().offset;
+			if(pos < windowStart || pos > nextReadOffset) {
+				// Outside of the window, e.g. after a seek.
+				invalidations++;
+				invalidate(pos);
+			}
+			for(Block& block : blocks) {
+				int64_t end = block.offset + (int64_t) block.data.size();
+				if(pos < block.offset || pos >= end) continue;
+				size_t n = std::min((size_t) size, (size_t) (end - pos));
+				memcpy(buf, &block.data[pos - block.offset], n);
+				pos += n;
+				if(readerWaiting && !hitEnd && !error) thread.wakeup.notify(); // maybe there is room again
+				return (int) n;
+			}
+			if(error) return -1;
+			if(hitEnd || pos >= fileSize) return 0;
+			if(!waited) {
+				waited = true;
+				readWaits++;
+			}
+			consumerWaiting = true;
+		}
+		// The reader thread is on it.
+		dataWakeup.wait(READAHEAD_IDLE_WAIT_SECS);
+	}
+}
+
+int64_t ReadAheadFile::seek(int64_t offset, int whence) {
+	if(fd < 0) return -1;
+	if(whence == AVSEEK_SIZE) return fileSize;
+	whence &= ~AVSEEK_FORCE;
+	PyScopedLock l(lock);
+	int64_t newPos = -1;
+	if(whence == SEEK_SET) newPos = offset;
+	else if(whence == SEEK_CUR) newPos = pos + offset;
+	else if(whence == SEEK_END) newPos = fileSize + offset;
+	if(newPos < 0) return -1;
+	// The window is invalidated in read() if needed, so that seeks within it are cheap.
+	pos = newPos;
+	return pos;
+}
@@ -0,0 +1,67 @@
+#ifndef MP_READAHEADFILE_HPP
+#define MP_READAHEADFILE_HPP
+
+#include "PyThreading.hpp"
+#include "LocalFile.hpp"
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <functional>
+
+#define READAHEAD_BLOCK_SIZE	(1024 * 256) // one read request of the reader thread
+#define READAHEAD_BLOCKS		8 // how much we read ahead, i.e. 2MB
+#define READAHEAD_KEEP_BLOCKS	1 // blocks behind the read position, for small backward seeks
+#define READAHEAD_IDLE_WAIT_SECS	1.0 // backstop, both sides otherwise wake up each other
+
+// Reads a local file in a reader thread ahead in large blocks and serves
+// the small reads (FFmpeg reads 4KB at a time) from memory. Thus the disk
+// or network latency (spinning disks, NFS) is not in the decode loop.
+// A read outside of the prefetched window (i.e. after a seek) invalidates it
+// and the reader thread starts again at the new position.
+// read()/seek() are for a single consumer. They don't need the GIL.
+struct ReadAheadFile : LocalFile {
+	// Like pread(). Can be replaced, e.g. to simulate a slow disk.
+	typedef std::function<ssize_t(int fd, void* buf, size_t size, off_t offset)> PreadFunc;
+
+	ReadAheadFile();
+	~ReadAheadFile();
+	bool open(const std::string& filename) { return open(filename, NULL); }
+	bool open(const std::string& filename, PreadFunc func);
+	void close();
+	bool isOpen() const { return fd >= 0; }
+
+	int read(uint8_t* buf, int size);
+	int64_t seek(int64_t offset, int whence);
+
+	// Statistics.
+	uint64_t blocksRead; // by the reader thread
+	uint64_t readWaits; // how often read() had to wait for the reader thread
+	uint64_t invalidations;
+
+private:
+	struct Block {
+		int64_t offset;
+		std::vector<uint8_t> data;
+	};
+
+	int fd;
+	int64_t fileSize;
+	PreadFunc preadFunc;
+	PyThread thread; // thread.wakeup is notified by the consumer, see readerWaiting
+	PyWakeup dataWakeup; // notified by the reader thread, see consumerWaiting
+	PyMutex lock; // covers the following
+	std::deque<Block> blocks; // contiguous, up to nextReadOffset
+	int64_t pos; // of the consumer
+	int64_t nextReadOffset; // where the reader thread goes on
+	unsigned long generation; // incremented on invalidation
+	bool hitEnd, error;
+	bool readerWaiting; // the reader thread has nothing to do until pos moves on or invalidate()
+	bool consumerWaiting; // read() waits for the next block
+
+	void invalidate(int64_t offset);
+	void readerProc(std::atomic<bool>& stopSignal);
+};
+
+#endif // MP_READAHEADFILE_HPP
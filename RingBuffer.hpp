@@ -0,0 +1,71 @@
+#ifndef MP_RINGBUFFER_HPP
+#define MP_RINGBUFFER_HPP
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stddef.h>
+#include "PyThreading.hpp" // mlock
+
+// Fixed-size lock-free ring for a single producer and a single consumer.
+// It never allocates after reset(), thus it can be used from the audio callback.
+// T must be trivially copyable.
+template<typename T>
+struct RingBuffer {
+	RingBuffer() : readPos(0), writePos(0) {}
+
+	// Not multithreading safe. Nobody must read or write meanwhile.
+	void reset(size_t capacity) {
+		data.assign(capacity + 1, T()); // one slot stays free to distinguish full from empty
+		if(!data.empty())
+			mlock(&data[0], data.size() * sizeof(T));
+		readPos = writePos = 0;
+	}
+
+	size_t capacity() const { return data.empty() ? 0 : data.size() - 1; }
+
+	// Safe from both sides, but only exact on the respective side.
+	size_t size() const {
+		size_t r = readPos, w = writePos;
+		return (w >= r) ? (w - r) : (w + data.size() - r);
+	}
+	size_t freeSpace() const { return capacity() - size(); }
+
+	// single producer. returns how much was written, i.e. <= num
+	size_t write(const T* src, size_t num) {
+		size_t w = writePos.load(std::memory_order_relaxed);
+		size_t r = readPos.load(std::memory_order_acquire);
+		size_t free = ((r > w) ? (r - w) : (r + data.size() - w)) - 1;
+		num = std::min(num, free);
+		size_t first = std::min(num, data.size() - w);
+		memcpy(&data[w], src, first * sizeof(T));
+		memcpy(&data[0], src + first, (num - first) * sizeof(T));
+		writePos.store((w + num) % data.size(), std::memory_order_release);
+		return num;
+	}
+
+	// single consumer. returns how much was read, i.e. <= num
+	size_t read(T* dst, size_t num) {
+		size_t r = readPos.load(std::memory_order_relaxed);
+		size_t w = writePos.load(std::memory_order_acquire);
+		size_t avail = (w >= r) ? (w - r) : (w + data.size() - r);
+		num = std::min(num, avail);
+		size_t first = std::min(num, data.size() - r);
+		memcpy(dst, &data[r], first * sizeof(T));
+		memcpy(dst + first, &data[0], (num - first) * sizeof(T));
+		readPos.store((r + num) % data.size(), std::memory_order_release);
+		return num;
+	}
+
+	// single consumer. drops everything which is there right now
+	void skipAll() {
+		readPos.store(writePos.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+private:
+	std::vector<T> data;
+	std::atomic<size_t> readPos, writePos;
+};
+
+#endif // MP_RINGBUFFER_HPP
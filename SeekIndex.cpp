@@ -0,0 +1,157 @@
+
+// must be first include because of Python stuff, see musicplayer.h comment
+#include "PyThreading.hpp"
+
+#include "SeekIndex.hpp"
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+
+#define SEEKINDEX_FILE_MAGIC	0x4953504d // "MPSI"
+#define SEEKINDEX_FILE_VERSION	1
+#define SEEKINDEX_MAX_ENTRIES	(1000 * 1000)
+
+struct SeekIndexFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	int64_t fileSize;
+	int64_t fileMTime;
+	uint64_t count;
+};
+
+static PyMutex& cacheDirMutex() {
+	static PyMutex mutex;
+	return mutex;
+}
+
+static std::string& cacheDir() {
+	static std::string dir;
+	return dir;
+}
+
+void setSeekIndexCacheDir(const std::string& dir) {
+	PyScopedLock lock(cacheDirMutex());
+	cacheDir() = dir;
+}
+
+// Returns an empty string if we cannot cache it.
+static std::string cacheFilename(const std::string& url, SeekIndexFileHeader& header) {
+	std::string dir;
+	{
+		PyScopedLock lock(cacheDirMutex());
+		dir = cacheDir();
+	}
+	if(dir.empty() || url.empty()) return "";
+
+	struct stat st;
+	if(stat(url.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return "";
+	header.magic = SEEKINDEX_FILE_MAGIC;
+	header.version = SEEKINDEX_FILE_VERSION;
+	header.fileSize = st.st_size;
+	header.fileMTime = st.st_mtime;
+	header.count = 0;
+
+	// 64bit FNV-1a. Must be stable across runs.
+	uint64_t hash = 14695981039346656037ULL;
+	for(unsigned char c : url) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.seekidx", (unsigned long long) hash);
+	if(dir[dir.size() - 1] != '/') dir += '/';
+	return dir + name;
+}
+
+void SeekIndex::add(double time, int64_t pos) {
+	if(time < 0 || pos < 0) return;
+	int64_t t = int64_t(time * 1000);
+	auto next = entries.lower_bound(t);
+	if(next != entries.end() && next->first - t < SEEKINDEX_STEP_MS) return;
+	if(next != entries.begin()) {
+		auto prev = next; --prev;
+		if(t - prev->first < SEEKINDEX_STEP_MS) return;
+	}
+	if(entries.size() >= SEEKINDEX_MAX_ENTRIES) return;
+	entries.insert(next, std::make_pair(t, pos));
+	changed = true;
+}
+
+bool SeekIndex::lookup(double time, Entry& entry) const {
+	auto it = entries.upper_bound(int64_t(time * 1000));
+	if(it == entries.begin()) return false;
+	--it;
+	entry.time = it->first / 1000.0;
+	entry.pos = it->second;
+	return true;
+}
+
+bool SeekIndex::load(const std::string& _url) {
+	entries.clear();
+	changed = false;
+	url = _url;
+
+	SeekIndexFileHeader expected;
+	std::string filename = cacheFilename(url, expected);
+	if(filename.empty()) return false;
+	FILE* f = fopen(filename.c_str(), "rb");
+	if(!f) return false;
+
+	bool success = false;
+	SeekIndexFileHeader header;
+	if(fread(&header, sizeof(header), 1, f) != 1) goto final;
+	if(header.magic != expected.magic || header.version != expected.version) goto final;
+	// The file was changed in the meantime.
+	if(header.fileSize != expected.fileSize || header.fileMTime != expected.fileMTime) goto final;
+	if(header.count > SEEKINDEX_MAX_ENTRIES) goto final;
+	for(uint64_t i = 0; i < header.count; ++i) {
+		int64_t e[2];
+		if(fread(e, sizeof(e), 1, f) != 1) {
+			entries.clear();
+			goto final;
+		}
+		entries.insert(entries.end(), std::make_pair(e[0], e[1]));
+	}
+	success = true;
+
+final:
+	fclose(f);
+	return success;
+}
+
+bool SeekIndex::save() {
+	SeekIndexFileHeader header;
+	std::string filename = cacheFilename(url, header);
+	if(filename.empty()) return false;
+	header.count = entries.size();
+
+	// Write to a temporary file first, so that a concurrent load() never sees a partial file.
+	// Unique also per save(), because two streams of the same url might save at the same time.
+	static std::atomic<unsigned long> tmpCounter(0);
+	char tmpSuffix[64];
+	snprintf(tmpSuffix, sizeof(tmpSuffix), ".%i.%lu.tmp", (int) getpid(), tmpCounter++);
+	std::string tmpFilename = filename + tmpSuffix;
+	FILE* f = fopen(tmpFilename.c_str(), "wb");
+	if(!f) {
+		printf("SeekIndex: cannot write %s\n", tmpFilename.c_str());
+		return false;
+	}
+
+	bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+	for(auto& e : entries) {
+		if(!success) break;
+		int64_t data[2] = {e.first, e.second};
+		success = fwrite(data, sizeof(data), 1, f) == 1;
+	}
+	if(fclose(f) != 0) success = false;
+	if(success)
+		success = rename(tmpFilename.c_str(), filename.c_str()) == 0;
+	if(!success) {
+		printf("SeekIndex: saving %s failed\n", filename.c_str());
+		unlink(tmpFilename.c_str());
+		return false;
+	}
+	changed = false;
+	return true;
+}
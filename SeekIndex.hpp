@@ -0,0 +1,44 @@
+#ifndef MP_SEEKINDEX_HPP
+#define MP_SEEKINDEX_HPP
+
+#include <stdint.h>
+#include <string>
+#include <map>
+
+#define SEEKINDEX_STEP_MS	1000 // don't add entries closer than this to an existing one
+
+// Maps song time to the byte offset of the packet which starts there.
+// It is learned from the packets we read while decoding (or while scanning),
+// and it is cached on disk (see setSeekIndexCacheDir()).
+// With it, we can seek fast and sample-accurate also in files without an
+// own index, e.g. VBR MP3 without a TOC, some Ogg or raw AAC.
+// Not multithreading safe, PlayerInStream::lock covers it.
+struct SeekIndex {
+	struct Entry {
+		double time;
+		int64_t pos;
+	};
+
+	std::map<int64_t, int64_t> entries; // time in ms -> byte offset
+	std::string url; // set by load()
+	bool changed;
+
+	SeekIndex() : changed(false) {}
+	void clear() { entries.clear(); url.clear(); changed = false; }
+	bool empty() const { return entries.empty(); }
+
+	void add(double time, int64_t pos);
+	// Last entry with entry.time <= time.
+	bool lookup(double time, Entry& entry) const;
+
+	// The cache file is identified by the url and validated against
+	// the size and modification time of the file at url.
+	// load() keeps the url also if it fails, so that save() works.
+	bool load(const std::string& url);
+	bool save();
+};
+
+// Empty dir (default) disables the disk cache.
+void setSeekIndexCacheDir(const std::string& dir);
+
+#endif // MP_SEEKINDEX_HPP
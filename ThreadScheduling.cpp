@@ -0,0 +1,203 @@
+
+// must be first include because of Python stuff, see musicplayer.h comment
+#include "PyThreading.hpp"
+
+#include "ThreadScheduling.hpp"
+#include "musicplayer.h"
+#include "PythonHelpers.h"
+#include "Py3Compat.h"
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include <errno.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+
+
+static PyMutex& infosMutex() {
+	static PyMutex mutex;
+	return mutex;
+}
+
+static std::map<std::string, std::string>& infos() {
+	static std::map<std::string, std::string> m;
+	return m;
+}
+
+void setThreadSchedulingInfo(const std::string& thread, const std::string& info) {
+	PyScopedLock lock(infosMutex());
+	infos()[thread] = info;
+}
+
+#define REALTIME_INFO_SLOTS	4 // audio and mixer, see setRealtime()
+
+struct RealtimeInfoSlot {
+	std::atomic<const char*> thread; // NULL if unused
+	std::atomic<bool> valid;
+	std::atomic<int> result, value, err;
+};
+
+// Static storage, thus zero-initialized.
+static RealtimeInfoSlot realtimeInfos[REALTIME_INFO_SLOTS];
+
+void setRealtimeSchedulingInfo(const char* thread, RealtimeSchedulingResult result, int value, int err) {
+	for(int i = 0; i < REALTIME_INFO_SLOTS; ++i) {
+		RealtimeInfoSlot& slot = realtimeInfos[i];
+		const char* slotThread = slot.thread;
+		if(!slotThread) {
+			const char* expected = NULL;
+			if(!slot.thread.compare_exchange_strong(expected, thread))
+				slotThread = expected; // someone else claimed it meanwhile
+			else
+				slotThread = thread;
+		}
+		if(strcmp(slotThread, thread) != 0) continue;
+		slot.valid = false;
+		slot.result = result;
+		slot.value = value;
+		slot.err = err;
+		slot.valid = true;
+		return;
+	}
+}
+
+static std::string realtimeInfoStr(const RealtimeInfoSlot& slot) {
+	std::ostringstream info;
+	switch(slot.result) {
+	case RealtimeSched_Fifo: info << "SCHED_FIFO priority " << slot.value; break;
+	case RealtimeSched_RR: info << "SCHED_RR priority " << slot.value; break;
+	case RealtimeSched_Nice: info << "nice " << slot.value; break;
+	case RealtimeSched_NiceUnchanged: info << "unchanged, nice " << slot.value; break;
+	case RealtimeSched_MacTimeConstraint: info << "THREAD_TIME_CONSTRAINT_POLICY"; break;
+	}
+	if(slot.result == RealtimeSched_Nice || slot.result == RealtimeSched_NiceUnchanged)
+		info << " (realtime scheduling not permitted: " << strerror(slot.err) << ")";
+	return info.str();
+}
+
+PyObject* pyGetThreadScheduling(PyObject* self) {
+	std::map<std::string, std::string> copy;
+	{
+		PyScopedGIUnlock gunlock;
+		PyScopedLock lock(infosMutex());
+		copy = infos();
+	}
+	for(int i = 0; i < REALTIME_INFO_SLOTS; ++i) {
+		const RealtimeInfoSlot& slot = realtimeInfos[i];
+		const char* thread = slot.thread;
+		if(thread && slot.valid)
+			copy[thread] = realtimeInfoStr(slot);
+	}
+	PyObject* dict = PyDict_New();
+	if(!dict) return NULL;
+	for(auto& it : copy)
+		PyDict_SetItemString_retain(dict, it.first.c_str(), PyString_FromString(it.second.c_str()));
+	return dict;
+}
+
+
+#ifdef __linux__
+
+static pid_t curThreadId() {
+	return (pid_t) syscall(SYS_gettid);
+}
+
+// Returns 0 on success, otherwise the error number.
+// pthread_setschedparam() returns it, it doesn't set errno.
+static int trySched(int policy, int priority) {
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+#ifdef SCHED_RESET_ON_FORK
+	// Child processes (e.g. some subprocess from Python) should not inherit it.
+	if(pthread_setschedparam(pthread_self(), policy | SCHED_RESET_ON_FORK, &param) == 0)
+		return 0;
+#endif
+	return pthread_setschedparam(pthread_self(), policy, &param);
+}
+
+// Called from the audio callback. No allocations here, see setRealtimeSchedulingInfo().
+void setCurThreadRealtimeLinux(const char* thread) {
+	int priority = std::min(AUDIO_RT_PRIORITY, sched_get_priority_max(SCHED_FIFO));
+	struct rlimit rl;
+	// Without CAP_SYS_NICE, RLIMIT_RTPRIO is the maximum (e.g. for the audio group).
+	if(getrlimit(RLIMIT_RTPRIO, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur > 0 && (int) rl.rlim_cur < priority)
+		priority = (int) rl.rlim_cur;
+
+	if(trySched(SCHED_FIFO, priority) == 0) {
+		setRealtimeSchedulingInfo(thread, RealtimeSched_Fifo, priority);
+		return;
+	}
+	int err = trySched(SCHED_RR, priority);
+	if(err == 0) {
+		setRealtimeSchedulingInfo(thread, RealtimeSched_RR, priority);
+		return;
+	}
+
+	// Fallback: the lowest nice value we are permitted to, up to AUDIO_FALLBACK_NICE.
+	int nice = AUDIO_FALLBACK_NICE;
+	if(getrlimit(RLIMIT_NICE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+		nice = std::max(nice, 20 - (int) rl.rlim_cur);
+	if(nice < getCurThreadNice() && setpriority(PRIO_PROCESS, curThreadId(), nice) == 0)
+		setRealtimeSchedulingInfo(thread, RealtimeSched_Nice, nice, err);
+	else
+		setRealtimeSchedulingInfo(thread, RealtimeSched_NiceUnchanged, getCurThreadNice(), err);
+}
+
+int getCurThreadNice() {
+	errno = 0;
+	int nice = getpriority(PRIO_PROCESS, curThreadId());
+	if(errno != 0) return 0;
+	return nice;
+}
+
+std::string setCurThreadNice(int nice) {
+	std::ostringstream info;
+	if(setpriority(PRIO_PROCESS, curThreadId(), nice) == 0)
+		info << "nice " << nice;
+	else
+		info << "nice " << getCurThreadNice() << " (nice " << nice << " failed: " << strerror(errno) << ")";
+	return info.str();
+}
+
+std::string setCurThreadAffinity(const std::vector<int>& cpus) {
+	std::ostringstream info;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(cpus.empty()) {
+		// The kernel restricts this to the allowed CPUs (cpuset).
+		for(int i = 0; i < CPU_SETSIZE; ++i)
+			CPU_SET(i, &set);
+	}
+	for(int cpu : cpus)
+		if(cpu >= 0 && cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &set);
+	int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if(ret != 0) {
+		info << "affinity failed: " << strerror(ret);
+		return info.str();
+	}
+	if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		return "affinity unknown";
+	info << "cpus";
+	for(int i = 0; i < CPU_SETSIZE; ++i)
+		if(CPU_ISSET(i, &set))
+			info << " " << i;
+	return info.str();
+}
+
+#else
+
+void setCurThreadRealtimeLinux(const char* thread) {}
+int getCurThreadNice() { return 0; }
+std::string setCurThreadNice(int nice) { return "nice not supported"; }
+std::string setCurThreadAffinity(const std::vector<int>& cpus) { return "affinity not supported"; }
+
+#endif
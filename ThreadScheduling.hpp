@@ -0,0 +1,36 @@
+#ifndef MP_THREADSCHEDULING_HPP
+#define MP_THREADSCHEDULING_HPP
+
+#include <string>
+#include <vector>
+
+#define AUDIO_RT_PRIORITY	70 // SCHED_FIFO priority of the audio thread (1-99), like JACK uses
+#define AUDIO_FALLBACK_NICE	-10 // if we are not permitted to use SCHED_FIFO/SCHED_RR
+
+// Thread scheduling on Linux. On other systems, these don't do anything.
+// What is actually applied (it depends on the permissions, e.g. RLIMIT_RTPRIO
+// and RLIMIT_NICE) is recorded per thread and returned by getThreadScheduling().
+
+void setThreadSchedulingInfo(const std::string& thread, const std::string& info);
+
+// What setRealtime() applied. That runs in the audio callback (on every stream
+// open), thus we must not allocate or lock there. This is kept in a fixed slot
+// per thread (a string literal) and getThreadScheduling() formats it.
+enum RealtimeSchedulingResult {
+	RealtimeSched_Fifo, // value is the priority
+	RealtimeSched_RR, // value is the priority
+	RealtimeSched_Nice, // value is the nice, err why realtime failed
+	RealtimeSched_NiceUnchanged, // value is the nice, err why realtime failed
+	RealtimeSched_MacTimeConstraint,
+};
+void setRealtimeSchedulingInfo(const char* thread, RealtimeSchedulingResult result, int value = 0, int err = 0);
+
+// For the audio thread. Tries SCHED_FIFO, then SCHED_RR, then a lower nice value.
+void setCurThreadRealtimeLinux(const char* thread);
+// Per-thread nice value. Returns a description of what was applied.
+int getCurThreadNice();
+std::string setCurThreadNice(int nice);
+// Empty cpus means all CPUs. Returns a description of what was applied.
+std::string setCurThreadAffinity(const std::vector<int>& cpus);
+
+#endif // MP_THREADSCHEDULING_HPP
@@ -21,9 +21,6 @@
 #include <assert.h>
 #include <algorithm>
 #include <stdio.h>
-extern "C" {
-#include "avresample/avcodec.h"
-}
 #include "debug.h"
 #include "audio_processor.h"
 
@@ -35,15 +32,13 @@ static const int kMaxBufferSize = 1024 * 16;
 
 // Resampler configuration
 static const int kResampleFilterLength = 16;
-static const int kResamplePhaseCount = 10;
-static const int kResampleLinear = 0;
 static const double kResampleCutoff = 0.8;
 
 AudioProcessor::AudioProcessor(int sample_rate, AudioConsumer *consumer)
 	: m_buffer_size(kMaxBufferSize),
 	  m_target_sample_rate(sample_rate),
 	  m_consumer(consumer),
-	  m_resample_ctx(0)
+	  m_resample(false)
 {
 	m_buffer = new short[kMaxBufferSize];
 	m_buffer_offset = 0;
@@ -52,9 +47,6 @@ AudioProcessor::AudioProcessor(int sample_rate, AudioConsumer *consumer)
 
 AudioProcessor::~AudioProcessor()
 {
-	if (m_resample_ctx) {
-		av_resample_close(m_resample_ctx);
-	}
 	delete[] m_resample_buffer;
 	delete[] m_buffer;
 }
@@ -111,17 +103,13 @@ int AudioProcessor::Load(short *input, int length)
 
 void AudioProcessor::Resample()
 {
-	if (!m_resample_ctx) {
+	if (!m_resample) {
 		m_consumer->Consume(m_buffer, m_buffer_offset);
 		m_buffer_offset = 0;
 		return;
 	}
 	int consumed = 0;
-	int length = av_resample(m_resample_ctx, m_resample_buffer, m_buffer, &consumed, m_buffer_offset, kMaxBufferSize, 1);
-	if (length > kMaxBufferSize) {
-		DEBUG() << "Chromaprint::AudioProcessor::Resample() -- Resampling overwrote output buffer.\n";
-		length = kMaxBufferSize;
-	}
+	int length = m_resampler.Resample(m_resample_buffer, kMaxBufferSize, m_buffer, m_buffer_offset, &consumed);
 	m_consumer->Consume(m_resample_buffer, length);
 	int remaining = m_buffer_offset - consumed;
 	if (remaining > 0) {
@@ -147,17 +135,12 @@ bool AudioProcessor::Reset(int sample_rate, int num_channels)
 		return false;
 	}
 	m_buffer_offset = 0;
-	if (m_resample_ctx) {
-		av_resample_close(m_resample_ctx);
-		m_resample_ctx = 0;
-	}
+	m_resample = false;
 	if (sample_rate != m_target_sample_rate) {
-		m_resample_ctx = av_resample_init(
-			m_target_sample_rate, sample_rate,
-			kResampleFilterLength,
-			kResamplePhaseCount,
-			kResampleLinear,
-			kResampleCutoff);
+		if (!m_resampler.Init(m_target_sample_rate, sample_rate, kResampleFilterLength, kResampleCutoff)) {
+			return false;
+		}
+		m_resample = true;
 	}
 	m_num_channels = num_channels;
 	return true;
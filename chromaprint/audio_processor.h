@@ -23,8 +23,7 @@
 
 #include "utils.h"
 #include "audio_consumer.h"
-
-struct AVResampleContext;
+#include "resampler.h"
 
 namespace Chromaprint
 {
@@ -78,7 +77,8 @@ namespace Chromaprint
 		int m_target_sample_rate;
 		int m_num_channels;
 		AudioConsumer *m_consumer;
-		struct AVResampleContext *m_resample_ctx;
+		Resampler m_resampler;
+		bool m_resample;
 	};
 
 };
@@ -20,73 +20,97 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <string.h>
+#include <stdint.h>
 #include "base64.h"
-#include "bit_string_writer.h"
 #include "debug.h"
 
 using namespace std;
 using namespace Chromaprint;
 
 static const char kBase64Chars[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
-static const char kBase64CharsReversed[128] = {
+static const char kBase64CharsReversed[256] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 62, 0, 0, 52,
 	53, 54, 55, 56, 57, 58, 59, 60, 61, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5,
 	6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
 	25, 0, 0, 0, 0, 63, 0, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37,
 	38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 0, 0, 0, 0, 0
+	// all non-ASCII characters map to 0
 };
 
+// Two output characters for each possible 12-bit value, so that we can
+// encode a full 3 byte group with two table lookups.
+// Only called once, via the function-local static in Base64Encode().
+static const char *Base64PairTable()
+{
+	static char table[4096 * 2];
+	for (int i = 0; i < 4096; i++) {
+		table[i * 2] = kBase64Chars[i >> 6];
+		table[i * 2 + 1] = kBase64Chars[i & 63];
+	}
+	return table;
+}
+
 string Chromaprint::Base64Encode(const string &orig)
 {
-	int size = orig.size();
-	int encoded_size = (size * 4 + 2) / 3;
+	static const char *pairs = Base64PairTable();
+	size_t size = orig.size();
+	size_t encoded_size = (size * 4 + 2) / 3;
 	string encoded(encoded_size, '\x00');
-	const unsigned char *src = (unsigned char *)orig.data();
-	string::iterator dest = encoded.begin();
-	while (size > 0) {
+	if (size == 0) {
+		return encoded;
+	}
+	const unsigned char *src = (const unsigned char *)orig.data();
+	char *dest = &encoded[0];
+	for (; size >= 3; size -= 3) {
+		uint32_t group = (src[0] << 16) | (src[1] << 8) | src[2];
+		memcpy(dest, pairs + (group >> 12) * 2, 2);
+		memcpy(dest + 2, pairs + (group & 4095) * 2, 2);
+		src += 3;
+		dest += 4;
+	}
+	if (size > 0) {
 		*dest++ = kBase64Chars[(src[0] >> 2)];
-		*dest++ = kBase64Chars[((src[0] << 4) | (--size ? (src[1] >> 4) : 0)) & 63];
-		if (size) {
-			*dest++ = kBase64Chars[((src[1] << 2) | (--size ? (src[2] >> 6) : 0)) & 63];
-			if (size) {
-				*dest++ = kBase64Chars[src[2] & 63];
-				--size;
-			}
+		*dest++ = kBase64Chars[((src[0] << 4) | (size > 1 ? (src[1] >> 4) : 0)) & 63];
+		if (size > 1) {
+			*dest++ = kBase64Chars[(src[1] << 2) & 63];
 		}
-		src += 3;
 	}
+	assert(dest == encoded.data() + encoded.size());
 	return encoded;
 }
 
 string Chromaprint::Base64Decode(const string &encoded)
 {
-	string str((3 * encoded.size()) / 4, '\x00');
+	size_t size = encoded.size();
+	string str((3 * size) / 4, '\x00');
+	if (str.empty()) {
+		return str;
+	}
 	const unsigned char *src = (const unsigned char *)encoded.data();
-	int size = encoded.size();
-	string::iterator dest = str.begin();
-	while (size > 0) {
-		int b0 = kBase64CharsReversed[*src++];
-		if (--size) {
-			int b1 = kBase64CharsReversed[*src++];
-			int r = (b0 << 2) | (b1 >> 4);
-			assert(dest != str.end());
-			*dest++ = r;
-			if (--size) {
-				int b2 = kBase64CharsReversed[*src++];
-				r = ((b1 << 4) & 255) | (b2 >> 2);
-				assert(dest != str.end());
-				*dest++ = r;
-				if (--size) {
-					int b3 = kBase64CharsReversed[*src++];
-					r = ((b2 << 6) & 255) | b3;
-					assert(dest != str.end());
-					*dest++ = r;
-					--size;
-				}
-			}
+	char *dest = &str[0];
+	for (; size >= 4; size -= 4) {
+		uint32_t group =
+			(kBase64CharsReversed[src[0]] << 18) |
+			(kBase64CharsReversed[src[1]] << 12) |
+			(kBase64CharsReversed[src[2]] <<  6) |
+			(kBase64CharsReversed[src[3]]      );
+		dest[0] = (char)(group >> 16);
+		dest[1] = (char)(group >> 8);
+		dest[2] = (char)group;
+		src += 4;
+		dest += 3;
+	}
+	if (size >= 2) {
+		int b0 = kBase64CharsReversed[src[0]];
+		int b1 = kBase64CharsReversed[src[1]];
+		*dest++ = (b0 << 2) | (b1 >> 4);
+		if (size >= 3) {
+			int b2 = kBase64CharsReversed[src[2]];
+			*dest++ = ((b1 << 4) & 255) | (b2 >> 2);
 		}
 	}
+	assert(dest == str.data() + str.size());
 	return str;
 }
-
@@ -0,0 +1,146 @@
+/*
+ * Chromaprint -- Audio fingerprinting toolkit
+ * Copyright (C) 2010  Lukas Lalinsky <lalinsky@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef CHROMAPRINT_BIT_PACKING_H_
+#define CHROMAPRINT_BIT_PACKING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace Chromaprint
+{
+
+	// Index (zero based) of the lowest set bit. x must not be 0.
+	inline int CountTrailingZeros(uint32_t x)
+	{
+#if defined(__GNUC__)
+		return __builtin_ctz(x);
+#else
+		int n = 0;
+		while ((x & 1) == 0) {
+			x >>= 1;
+			n++;
+		}
+		return n;
+#endif
+	}
+
+	// Appends `size` values of `Bits` bits each to `output`, using the same
+	// LSB-first layout as BitStringWriter. The values must already fit into
+	// `Bits` bits. Eight values always fill exactly `Bits` bytes, so the main
+	// loop works on whole groups and never has to deal with single bits.
+	template<int Bits, class Value>
+	void PackBits(const Value *values, size_t size, std::string &output)
+	{
+		size_t offset = output.size();
+		output.resize(offset + (size * Bits + 7) / 8);
+		unsigned char *dest = (unsigned char *)&output[offset];
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			uint64_t group = 0;
+			for (int j = 0; j < 8; j++) {
+				group |= uint64_t(values[i + j]) << (j * Bits);
+			}
+			for (int j = 0; j < Bits; j++) {
+				*dest++ = (unsigned char)(group >> (j * 8));
+			}
+		}
+		uint64_t group = 0;
+		int group_bits = 0;
+		for (; i < size; i++) {
+			group |= uint64_t(values[i]) << group_bits;
+			group_bits += Bits;
+		}
+		for (; group_bits > 0; group_bits -= 8) {
+			*dest++ = (unsigned char)group;
+			group >>= 8;
+		}
+	}
+
+	// Number of set bits.
+	inline int CountBits(uint32_t x)
+	{
+#if defined(__GNUC__)
+		return __builtin_popcount(x);
+#else
+		int n = 0;
+		for (; x; x &= x - 1) {
+			n++;
+		}
+		return n;
+#endif
+	}
+
+	// Reverse of PackBits(): reads the values one by one, but loads the
+	// input in whole groups of eight values (`Bits` bytes). Never reads
+	// at or beyond end, the values from there are zero (like
+	// BitStringReader does it).
+	template<int Bits>
+	class UnpackBitsReader
+	{
+	public:
+		UnpackBitsReader(const unsigned char *src, const unsigned char *end)
+			: m_src(src), m_end(end), m_group(0), m_left(0)
+		{
+		}
+
+		int Read()
+		{
+			if (m_left == 0) {
+				m_group = LoadGroup();
+				m_left = 8;
+			}
+			int value = int(m_group & ((1 << Bits) - 1));
+			m_group >>= Bits;
+			m_left--;
+			return value;
+		}
+
+		// The next eight values, in the lowest 8 * Bits bits.
+		// Only valid while nothing was read via Read() in between.
+		uint64_t LoadGroup()
+		{
+			uint64_t group = 0;
+			if (m_end - m_src >= Bits) {
+				for (int j = 0; j < Bits; j++) {
+					group |= uint64_t(m_src[j]) << (j * 8);
+				}
+				m_src += Bits;
+			}
+			else {
+				for (int j = 0; m_src < m_end; j++) {
+					group |= uint64_t(*m_src++) << (j * 8);
+				}
+			}
+			return group;
+		}
+
+	private:
+		const unsigned char *m_src;
+		const unsigned char *m_end;
+		uint64_t m_group;
+		int m_left;
+	};
+
+};
+
+#endif
+
@@ -148,6 +148,49 @@ int chromaprint_decode_fingerprint(void *encoded_fp, int encoded_size, void **fp
 	return 1;
 }
 
+int chromaprint_encode_fingerprints(const void *const *fps, const int *sizes, int count, int algorithm, void **encoded_fps, int *encoded_offsets, int base64)
+{
+	FingerprintCompressor compressor;
+	vector<int32_t> uncompressed;
+	string result;
+	for (int i = 0; i < count; i++) {
+		encoded_offsets[i] = result.size();
+		const int32_t *fp = (const int32_t *)fps[i];
+		uncompressed.assign(fp, fp + sizes[i]);
+		string compressed = compressor.Compress(uncompressed, algorithm);
+		result += base64 ? Chromaprint::Base64Encode(compressed) : compressed;
+	}
+	encoded_offsets[count] = result.size();
+	*encoded_fps = malloc(result.size() + 1);
+	if (!*encoded_fps) {
+		return 0;
+	}
+	copy(result.begin(), result.end(), (char *)*encoded_fps);
+	((char *)*encoded_fps)[result.size()] = 0;
+	return 1;
+}
+
+int chromaprint_decode_fingerprints(const void *const *encoded_fps, const int *encoded_sizes, int count, void **fps, int *offsets, int *algorithms, int base64)
+{
+	FingerprintDecompressor decompressor;
+	string encoded;
+	vector<int32_t> result;
+	for (int i = 0; i < count; i++) {
+		offsets[i] = result.size();
+		encoded.assign((const char *)encoded_fps[i], encoded_sizes[i]);
+		algorithms[i] = -1; // stays if the fingerprint is invalid
+		vector<int32_t> uncompressed = decompressor.Decompress(base64 ? Chromaprint::Base64Decode(encoded) : encoded, &algorithms[i]);
+		result.insert(result.end(), uncompressed.begin(), uncompressed.end());
+	}
+	offsets[count] = result.size();
+	*fps = malloc(sizeof(int32_t) * std::max(result.size(), size_t(1)));
+	if (!*fps) {
+		return 0;
+	}
+	copy(result.begin(), result.end(), (int32_t *)*fps);
+	return 1;
+}
+
 void chromaprint_dealloc(void *ptr)
 {
 	free(ptr);
@@ -58,6 +58,10 @@ enum ChromaprintAlgorithm {
 
 #define CHROMAPRINT_ALGORITHM_DEFAULT CHROMAPRINT_ALGORITHM_TEST2
 
+// Not in upstream Chromaprint. Set if chromaprint_encode_fingerprints()
+// and chromaprint_decode_fingerprints() are available.
+#define CHROMAPRINT_HAVE_BATCH_CODEC 1
+
 /**
  * Return the version number of Chromaprint.
  */
@@ -235,6 +239,65 @@ CHROMAPRINT_API int chromaprint_encode_fingerprint(void *fp, int size, int algor
  */
 CHROMAPRINT_API int chromaprint_decode_fingerprint(void *encoded_fp, int encoded_size, void **fp, int *size, int *algorithm, int base64);
 
+/**
+ * Compress and optionally base64-encode many raw fingerprints in one call
+ *
+ * This gives the same results as calling chromaprint_encode_fingerprint()
+ * for each fingerprint, but all encoded fingerprints are stored one after
+ * another in a single allocated buffer and the internal buffers are reused.
+ * Use this when encoding fingerprints in bulk.
+ *
+ * The caller is responsible for freeing the returned pointer using
+ * chromaprint_dealloc().
+ *
+ * Parameters:
+ *  - fps: array of count pointers to the raw fingerprints (arrays of
+ *         32-bit integers)
+ *  - sizes: array of count items, number of items in each raw fingerprint
+ *  - count: number of fingerprints
+ *  - algorithm: Chromaprint algorithm version which was used to generate the
+ *               raw fingerprints
+ *  - encoded_fps: pointer to a pointer, where the encoded fingerprints will be
+ *                 stored
+ *  - encoded_offsets: array of count + 1 items. Item i is set to the offset in
+ *                     bytes of the i-th encoded fingerprint, the last item to
+ *                     the total size
+ *  - base64: Whether to return binary data or base64-encoded ASCII data,
+ *            see chromaprint_encode_fingerprint()
+ *
+ * Returns:
+ *  - 0 on error, 1 on success
+ */
+CHROMAPRINT_API int chromaprint_encode_fingerprints(const void *const *fps, const int *sizes, int count, int algorithm, void **encoded_fps, int *encoded_offsets, int base64);
+
+/**
+ * Uncompress and optionally base64-decode many encoded fingerprints in one call
+ *
+ * This is the reverse of chromaprint_encode_fingerprints(). All decoded raw
+ * fingerprints are stored one after another in a single allocated array.
+ *
+ * The caller is responsible for freeing the returned pointer using
+ * chromaprint_dealloc().
+ *
+ * Parameters:
+ *  - encoded_fps: array of count pointers to the encoded fingerprints
+ *  - encoded_sizes: array of count items, size of each encoded fingerprint
+ *                   in bytes
+ *  - count: number of fingerprints
+ *  - fps: pointer to a pointer, where the decoded raw fingerprints (array
+ *         of 32-bit integers) will be stored
+ *  - offsets: array of count + 1 items. Item i is set to the index of the
+ *             first item of the i-th raw fingerprint, the last item to the
+ *             total number of items
+ *  - algorithms: array of count items, algorithm of each fingerprint
+ *  - base64: Whether the encoded fingerprints contain binary data or
+ *            base64-encoded ASCII data, see chromaprint_decode_fingerprint()
+ *
+ * Returns:
+ *  - 0 on error, 1 on success
+ */
+CHROMAPRINT_API int chromaprint_decode_fingerprints(const void *const *encoded_fps, const int *encoded_sizes, int count, void **fps, int *offsets, int *algorithms, int base64);
+
 /**
  * Free memory allocated by any function from the Chromaprint API.
  *
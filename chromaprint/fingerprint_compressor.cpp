@@ -20,7 +20,7 @@
 
 #include <algorithm>
 #include "fingerprint_compressor.h"
-#include "bit_string_writer.h"
+#include "bit_packing.h"
 #include "debug.h"
 #include "utils.h"
 
@@ -32,47 +32,53 @@ static const int kNormalBits = 3;
 static const int kExceptionBits = 5;
 
 FingerprintCompressor::FingerprintCompressor()
+	: m_bits_end(0), m_exception_bits_end(0)
 {
 }
 
 void FingerprintCompressor::ProcessSubfingerprint(uint32_t x)
 {
-	int bit = 1, last_bit = 0;
+	// m_bits and m_exception_bits are big enough for the worst case,
+	// see Compress(), so we can just write via the pointers here.
+	int last_bit = 0;
 	while (x != 0) {
-		if ((x & 1) != 0) {
-			m_bits.push_back(bit - last_bit);
-			last_bit = bit;
+		int bit = CountTrailingZeros(x) + 1;
+		int value = bit - last_bit;
+		if (value >= kMaxNormalValue) {
+			*m_bits_end++ = kMaxNormalValue;
+			*m_exception_bits_end++ = value - kMaxNormalValue;
 		}
-		x >>= 1;
-		bit++;
+		else {
+			*m_bits_end++ = value;
+		}
+		last_bit = bit;
+		x &= x - 1;
 	}
-	m_bits.push_back(0);
+	*m_bits_end++ = 0;
 }
 
 void FingerprintCompressor::WriteNormalBits()
 {
-	BitStringWriter writer;
-	for (size_t i = 0; i < m_bits.size(); i++) {
-		writer.Write(min(int(m_bits[i]), kMaxNormalValue), kNormalBits);
-	}
-	writer.Flush();
-	m_result += writer.value();
+	PackBits<kNormalBits>(m_bits.data(), m_bits_end - m_bits.data(), m_result);
 }
 
 void FingerprintCompressor::WriteExceptionBits()
 {
-	BitStringWriter writer;
-	for (size_t i = 0; i < m_bits.size(); i++) {
-		if (m_bits[i] >= kMaxNormalValue) {
-			writer.Write(int(m_bits[i]) - kMaxNormalValue, kExceptionBits);
-		}
-	}
-	writer.Flush();
-	m_result += writer.value();
+	PackBits<kExceptionBits>(m_exception_bits.data(), m_exception_bits_end - m_exception_bits.data(), m_result);
 }
 
 std::string FingerprintCompressor::Compress(const vector<int32_t> &data, int algorithm)
 {
+	// The buffers are kept between calls so that compressing many
+	// fingerprints with the same compressor doesn't reallocate them.
+	// Each subfingerprint produces at most 32 values plus the terminating 0,
+	// and at most 32 / kMaxNormalValue exception values.
+	if (m_bits.size() < data.size() * 33) {
+		m_bits.resize(data.size() * 33);
+		m_exception_bits.resize(data.size() * (32 / kMaxNormalValue));
+	}
+	m_bits_end = m_bits.data();
+	m_exception_bits_end = m_exception_bits.data();
 	if (data.size() > 0) {
 		ProcessSubfingerprint(data[0]);
 		for (size_t i = 1; i < data.size(); i++) {
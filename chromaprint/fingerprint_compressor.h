@@ -44,7 +44,10 @@ namespace Chromaprint
 		void ProcessSubfingerprint(uint32_t);
 
 		std::string m_result;
-		std::vector<char> m_bits; 
+		std::vector<unsigned char> m_bits;
+		std::vector<unsigned char> m_exception_bits;
+		unsigned char *m_bits_end;
+		unsigned char *m_exception_bits_end;
 	};
 
 	inline std::string CompressFingerprint(const std::vector<int32_t> &data, int algorithm = 0)
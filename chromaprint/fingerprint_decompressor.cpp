@@ -19,6 +19,7 @@
  */
 
 #include "fingerprint_decompressor.h"
+#include "bit_packing.h"
 #include "debug.h"
 #include "utils.h"
 
@@ -33,67 +34,96 @@ FingerprintDecompressor::FingerprintDecompressor()
 {
 }
 
-void FingerprintDecompressor::UnpackBits()
+// Number of normal (3 bit) values up to and including the length-th zero,
+// i.e. the size of the normal bits section. Counts the zeros of whole
+// groups of eight values at once.
+static size_t CountNormalBits(const unsigned char *src, const unsigned char *end, size_t length)
 {
-	int i = 0, last_bit = 0, value = 0;
-	for (size_t j = 0; j < m_bits.size(); j++) {
-		int bit = m_bits[j];
-		if (bit == 0) {
-			m_result[i] = (i > 0) ? value ^ m_result[i - 1] : value;
-			value = 0;
-			last_bit = 0;
-			i++;
+	UnpackBitsReader<kNormalBits> reader(src, end);
+	size_t count = 0, zeros = 0;
+	while (zeros < length) {
+		uint32_t group = uint32_t(reader.LoadGroup());
+		// lowest bit of each value set if all its bits are zero
+		uint32_t z = ~group & 0xFFFFFF;
+		z = z & (z >> 1) & (z >> 2) & 0x249249;
+		size_t n = CountBits(z);
+		if (zeros + n < length) {
+			zeros += n;
+			count += 8;
 			continue;
 		}
-		bit += last_bit;
-		last_bit = bit;
-		value |= 1 << (bit - 1);
+		for (; ; z &= z - 1) {
+			if (++zeros == length) {
+				return count + CountTrailingZeros(z) / kNormalBits + 1;
+			}
+		}
 	}
+	return count;
 }
 
-void FingerprintDecompressor::ReadNormalBits(BitStringReader *reader)
+void FingerprintDecompressor::UnpackBits(const unsigned char *src, const unsigned char *end)
 {
+	size_t num_normal_bits = CountNormalBits(src, end, m_result.size());
+	// The exception bits start at the byte after the normal bits.
+	size_t normal_size = (num_normal_bits * kNormalBits + 7) / 8;
+	const unsigned char *exception_src = (size_t(end - src) > normal_size) ? src + normal_size : end;
+
+	UnpackBitsReader<kNormalBits> normal_bits(src, end);
+	UnpackBitsReader<kExceptionBits> exception_bits(exception_src, end);
+	int32_t *result = m_result.data();
 	size_t i = 0;
-	while (i < m_result.size()) {
-		int bit = reader->Read(kNormalBits);
+	int last_bit = 0;
+	uint32_t value = 0;
+	for (size_t j = 0; j < num_normal_bits; j++) {
+		int bit = normal_bits.Read();
 		if (bit == 0) {
+			result[i] = (i > 0) ? int32_t(value) ^ result[i - 1] : int32_t(value);
+			value = 0;
+			last_bit = 0;
 			i++;
+			continue;
 		}
-		m_bits.push_back(bit);
-	}
-}
-
-void FingerprintDecompressor::ReadExceptionBits(BitStringReader *reader)
-{
-	for (size_t i = 0; i < m_bits.size(); i++) {
-		if (m_bits[i] == kMaxNormalValue) {
-			m_bits[i] += reader->Read(kExceptionBits);
+		if (bit == kMaxNormalValue) {
+			bit += exception_bits.Read();
+		}
+		bit += last_bit;
+		last_bit = bit;
+		// only broken fingerprints have bits beyond 32
+		if (bit <= 32) {
+			value |= 1u << (bit - 1);
 		}
 	}
 }
 
 std::vector<int32_t> FingerprintDecompressor::Decompress(const string &data, int *algorithm)
 {
-	if (algorithm) {
-		*algorithm = data[0];
+	// m_result is kept between calls so that decompressing many
+	// fingerprints with the same decompressor doesn't reallocate it.
+	m_result.clear();
+	if (data.size() < 4) {
+		DEBUG() << "FingerprintDecompressor::Decompress() -- Invalid fingerprint (shorter than header)\n";
+		return m_result;
 	}
-	int length =
+
+	size_t length =
 		((unsigned char)(data[1]) << 16) |
 		((unsigned char)(data[2]) <<  8) |
 		((unsigned char)(data[3])      );
 
-	BitStringReader reader(data);
-	reader.Read(8);
-	reader.Read(8);
-	reader.Read(8);
-	reader.Read(8);
+	const unsigned char *src = (const unsigned char *)data.data() + 4;
+	const unsigned char *end = (const unsigned char *)data.data() + data.size();
 
-	m_result = vector<int32_t>(length, -1);
-	reader.Reset();
-	ReadNormalBits(&reader);
-	reader.Reset();
-	ReadExceptionBits(&reader);
-	UnpackBits();
+	// Each subfingerprint needs at least one 3 bit value (the terminating 0).
+	// Don't let a broken header make us allocate much more than the data.
+	if (length > size_t(end - src) * 8 / kNormalBits) {
+		DEBUG() << "FingerprintDecompressor::Decompress() -- Invalid fingerprint (length doesn't match data)\n";
+		return m_result;
+	}
+
+	if (algorithm) {
+		*algorithm = data[0];
+	}
+	m_result.resize(length, -1);
+	UnpackBits(src, end);
 	return m_result;
 }
-
@@ -24,7 +24,6 @@
 #include <stdint.h>
 #include <vector>
 #include <string>
-#include "bit_string_reader.h"
 
 namespace Chromaprint
 {
@@ -36,12 +35,9 @@ namespace Chromaprint
 
 	private:
 
-		void ReadNormalBits(BitStringReader *reader);
-		void ReadExceptionBits(BitStringReader *reader);
-		void UnpackBits();
+		void UnpackBits(const unsigned char *src, const unsigned char *end);
 
 		std::vector<int32_t> m_result;
-		std::vector<char> m_bits;
 	};
 
 	inline std::vector<int32_t> DecompressFingerprint(const std::string &data, int *algorithm = 0)
@@ -0,0 +1,174 @@
+/*
+ * Chromaprint -- Audio fingerprinting toolkit
+ * Copyright (C) 2010-2011  Lukas Lalinsky <lalinsky@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "debug.h"
+#include "resampler.h"
+
+using namespace std;
+using namespace Chromaprint;
+
+// Same as FILTER_SHIFT and WINDOW_TYPE in the old resample2.c.
+static const int kFilterShift = 15;
+static const int kKaiserBeta = 9;
+
+// Out-of-class definition, because std::min() binds it to a reference.
+const int Resampler::kMaxPhaseCount;
+
+// 0th order modified Bessel function of the first kind.
+static double Bessel(double x)
+{
+	double v = 1;
+	double last_v = 0;
+	double t = 1;
+	x = x * x / 4;
+	for (int i = 1; v != last_v; i++) {
+		last_v = v;
+		t *= x / (i * i);
+		v += t;
+	}
+	return v;
+}
+
+static int GreatestCommonDivisor(int a, int b)
+{
+	while (b) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+Resampler::Resampler()
+	: m_filter_length(0), m_filter_stride(0), m_phase_count(0),
+	  m_out_step(1), m_in_step_int(1), m_in_step_frac(0),
+	  m_index(0), m_phase(0)
+{
+}
+
+bool Resampler::Init(int out_rate, int in_rate, int filter_size, double cutoff)
+{
+	if (out_rate <= 0 || in_rate <= 0 || filter_size <= 0) {
+		DEBUG() << "Chromaprint::Resampler::Init() -- Invalid parameters.\n";
+		return false;
+	}
+	int gcd = GreatestCommonDivisor(out_rate, in_rate);
+	m_out_step = out_rate / gcd;
+	m_in_step_int = (in_rate / gcd) / m_out_step;
+	m_in_step_frac = (in_rate / gcd) % m_out_step;
+	m_phase_count = min(m_out_step, kMaxPhaseCount);
+
+	// If upsampling, we only need to interpolate, no filter.
+	double factor = min(out_rate * cutoff / in_rate, 1.0);
+	m_filter_length = max((int)ceil(filter_size / factor), 1);
+	m_filter_stride = (m_filter_length + 7) & ~7;
+	m_filter_bank.assign(m_filter_stride * m_phase_count, 0);
+
+	const int center = (m_filter_length - 1) / 2;
+	vector<double> tab(m_filter_length);
+	for (int ph = 0; ph < m_phase_count; ph++) {
+		double norm = 0;
+		for (int i = 0; i < m_filter_length; i++) {
+			double x = M_PI * ((double)(i - center) - (double)ph / m_phase_count) * factor;
+			double y = (x == 0) ? 1.0 : sin(x) / x;
+			double w = 2.0 * x / (factor * m_filter_length * M_PI);
+			y *= Bessel(kKaiserBeta * sqrt(max(1 - w * w, 0.0)));
+			tab[i] = y;
+			norm += y;
+		}
+		// Normalize so that a constant signal stays the same.
+		int16_t *filter = &m_filter_bank[ph * m_filter_stride];
+		for (int i = 0; i < m_filter_length; i++) {
+			long value = lrint(tab[i] * (1 << kFilterShift) / norm);
+			filter[i] = (int16_t)max(min(value, 32767L), -32768L);
+		}
+	}
+
+	// Center the filter on the first input sample. The samples before it
+	// are mirrored, like resample2.c did.
+	m_index = -center;
+	m_phase = 0;
+	return true;
+}
+
+int Resampler::Filter(const short *src, int src_size, int sample_index, const int16_t *filter) const
+{
+	if (sample_index < 0) {
+		int sum = 0;
+		for (int i = 0; i < m_filter_length; i++) {
+			sum += src[abs(sample_index + i) % src_size] * filter[i];
+		}
+		return sum;
+	}
+	src += sample_index;
+#if defined(__SSE2__)
+	__m128i acc = _mm_setzero_si128();
+	for (int i = 0; i < m_filter_stride; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i f = _mm_loadu_si128((const __m128i *)(filter + i));
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(s, f));
+	}
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(acc);
+#else
+	int sum = 0;
+	for (int i = 0; i < m_filter_stride; i++) {
+		sum += src[i] * filter[i];
+	}
+	return sum;
+#endif
+}
+
+int Resampler::Resample(short *dst, int dst_size, const short *src, int src_size, int *consumed)
+{
+	int index = m_index;
+	int phase = m_phase;
+	int dst_index = 0;
+	for (; dst_index < dst_size; dst_index++) {
+		if (index + m_filter_stride > src_size) {
+			break;
+		}
+		int filter_phase = phase;
+		if (m_phase_count != m_out_step) {
+			filter_phase = (int)((int64_t)phase * m_phase_count / m_out_step);
+		}
+		int val = Filter(src, src_size, index, &m_filter_bank[filter_phase * m_filter_stride]);
+		val = (val + (1 << (kFilterShift - 1))) >> kFilterShift;
+		dst[dst_index] = (short)max(min(val, 32767), -32768);
+
+		index += m_in_step_int;
+		phase += m_in_step_frac;
+		if (phase >= m_out_step) {
+			phase -= m_out_step;
+			index++;
+		}
+	}
+	*consumed = max(index, 0);
+	m_index = index - *consumed;
+	m_phase = phase;
+	return dst_index;
+}
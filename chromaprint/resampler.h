@@ -0,0 +1,81 @@
+/*
+ * Chromaprint -- Audio fingerprinting toolkit
+ * Copyright (C) 2010-2011  Lukas Lalinsky <lalinsky@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef CHROMAPRINT_RESAMPLER_H_
+#define CHROMAPRINT_RESAMPLER_H_
+
+#include <stdint.h>
+#include <vector>
+#include "utils.h"
+
+namespace Chromaprint
+{
+
+	// Polyphase FIR resampler for mono int16 audio.
+	//
+	// It uses the same Kaiser windowed sinc filter design as the FFmpeg
+	// resample2.c code we used before, but for rational ratios like
+	// 44100->11025 (1/4) or 48000->11025 (147/640) every output sample maps
+	// to one exact precomputed phase, so there is no phase quantization and
+	// no per-sample interpolation. Only very odd ratios, which would need
+	// more than kMaxPhaseCount phases, fall back to quantized phases.
+	//
+	// The filter taps are padded to a multiple of 8, so the inner loop is a
+	// plain int16 dot product without a tail (SSE2 when available).
+	class Resampler
+	{
+	public:
+		Resampler();
+
+		//! Prepare for a new stream. Returns false for invalid rates.
+		bool Init(int out_rate, int in_rate, int filter_size, double cutoff);
+
+		//! Resample as much of src as possible into dst.
+		//! consumed is set to the number of input samples which are not
+		//! needed anymore; the caller must keep the rest and pass it again,
+		//! followed by new data. Returns the number of output samples.
+		int Resample(short *dst, int dst_size, const short *src, int src_size, int *consumed);
+
+		int filter_length() const { return m_filter_length; }
+		int phase_count() const { return m_phase_count; }
+
+		static const int kMaxPhaseCount = 1024;
+
+	private:
+		CHROMAPRINT_DISABLE_COPY(Resampler);
+
+		int Filter(const short *src, int src_size, int sample_index, const int16_t *filter) const;
+
+		std::vector<int16_t> m_filter_bank;
+		int m_filter_length; // real taps
+		int m_filter_stride; // taps padded to a multiple of 8
+		int m_phase_count;
+		// Input position of the next output sample is
+		// m_index + m_phase / m_out_step, in input samples.
+		int m_out_step;
+		int m_in_step_int;
+		int m_in_step_frac;
+		int m_index;
+		int m_phase;
+	};
+
+};
+
+#endif
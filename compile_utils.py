@@ -159,7 +159,7 @@ LinkPython = False
 UsePyPy = False
 Python3 = True
 
-ffmpeg_packages = ['libavutil', 'libavformat', 'libavcodec', 'libswresample']
+ffmpeg_packages = ['libavutil', 'libavformat', 'libavcodec', 'libswresample', 'libswscale']
 
 
 def find_exec_in_path(exec_name):
@@ -214,6 +214,7 @@ def get_python_linkopts():
             "-lavformat",
             "-lavcodec",
             "-lswresample",
+            "-lswscale",
             "-lportaudio"]
     pkg_flags = get_pkg_config("--libs", "portaudio")
     if pkg_flags is not None:
@@ -45,12 +45,19 @@
 static PyMethodDef module_methods[] = {
 	{"createPlayer",	(PyCFunction)pyCreatePlayer,	METH_NOARGS,	"creates new player"},
 	{"getSoundDevices", (PyCFunction)pyGetSoundDevices, METH_NOARGS,	"get list of sound device names"},
-	{"getMetadata",		pyGetMetadata,	METH_VARARGS,	"get metadata for Song"},
+	{"getThreadScheduling", (PyCFunction)pyGetThreadScheduling, METH_NOARGS,	"get the applied scheduling (realtime, nice, CPU affinity) per thread"},
+	{"enableLockProfiler",	pyEnableLockProfiler,	METH_VARARGS,	"record the waits on our locks, the GIL and the spin-waits (default off)"},
+	{"getLockProfile",	(PyCFunction)pyGetLockProfile,	METH_VARARGS|METH_KEYWORDS,	"get the worst lock waits (by total wait time) per call site"},
+	{"getMetadata",		(PyCFunction)pyGetMetadata,	METH_VARARGS|METH_KEYWORDS,	"get metadata (and optionally cover art) for Song"},
+	{"getMetadataBatch",	(PyCFunction)pyGetMetadataBatch,	METH_VARARGS|METH_KEYWORDS,	"get metadata for a list of Songs or filenames, in parallel"},
 	{"calcAcoustIdFingerprint",		pyCalcAcoustIdFingerprint,	METH_VARARGS,	"calculate AcoustID fingerprint for Song"},
+	{"encodeAcoustIdFingerprints",		(PyCFunction)pyEncodeAcoustIdFingerprints,	METH_VARARGS|METH_KEYWORDS,	"compress (and base64 encode) a list of raw AcoustID fingerprints (int32 buffers)"},
+	{"decodeAcoustIdFingerprints",		(PyCFunction)pyDecodeAcoustIdFingerprints,	METH_VARARGS|METH_KEYWORDS,	"decode a list of AcoustID fingerprints to a list of (algorithm, raw int32 bytes)"},
 	{"calcBitmapThumbnail",		(PyCFunction)pyCalcBitmapThumbnail,	METH_VARARGS|METH_KEYWORDS,	"calculate bitmap thumbnail for Song"},
 	{"calcReplayGain",		(PyCFunction)pyCalcReplayGain,	METH_VARARGS|METH_KEYWORDS,	"calculate ReplayGain for Song"},
 	{"setFfmpegLogLevel",		pySetFfmpegLogLevel,	METH_VARARGS,	"set FFmpeg log level (av_log_set_level)"},
 	{"enableDebugLog",	(PyCFunction)pyEnableDebugLog,	METH_VARARGS,	"enable/disable debug log"},
+	{"setSeekIndexCacheDir",	pySetSeekIndexCacheDir,	METH_VARARGS,	"set directory where seek indexes for files without an own index are cached ('' disables it)"},
 	{NULL,				NULL}	/* sentinel */
 };
 
@@ -89,6 +96,8 @@ PyMODINIT_FUNC PyInit_musicplayer(void)
 	init();
 	if (PyType_Ready(&Player_Type) < 0)
 		Py_FatalError("Can't initialize player type");
+	if (PyType_Ready(&AVBuffer_Type) < 0)
+		Py_FatalError("Can't initialize AVBuffer type");
 
 #if PY_MAJOR_VERSION == 2
 	PyObject* m = Py_InitModule3(module_name, module_methods, module_doc);
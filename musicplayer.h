@@ -22,13 +22,21 @@ int initPlayerDecoder();
 int initPlayerOutput();
 
 extern PyTypeObject Player_Type;
+extern PyTypeObject AVBuffer_Type;
 
 PyObject* pyCreatePlayer(PyObject* self);
 PyObject* pyGetSoundDevices(PyObject* self);
 PyObject* pySetFfmpegLogLevel(PyObject* self, PyObject* args);
 PyObject* pyEnableDebugLog(PyObject* self, PyObject* args);
-PyObject* pyGetMetadata(PyObject* self, PyObject* args);
+PyObject* pySetSeekIndexCacheDir(PyObject* self, PyObject* args);
+PyObject* pyGetThreadScheduling(PyObject* self);
+PyObject* pyEnableLockProfiler(PyObject* self, PyObject* args);
+PyObject* pyGetLockProfile(PyObject* self, PyObject* args, PyObject* kws);
+PyObject* pyGetMetadata(PyObject* self, PyObject* args, PyObject* kws);
+PyObject* pyGetMetadataBatch(PyObject* self, PyObject* args, PyObject* kws);
 PyObject* pyCalcAcoustIdFingerprint(PyObject* self, PyObject* args);
+PyObject* pyEncodeAcoustIdFingerprints(PyObject* self, PyObject* args, PyObject* kws);
+PyObject* pyDecodeAcoustIdFingerprints(PyObject* self, PyObject* args, PyObject* kws);
 PyObject* pyCalcBitmapThumbnail(PyObject* self, PyObject* args, PyObject* kws);
 PyObject* pyCalcReplayGain(PyObject* self, PyObject* args, PyObject* kws);
 
@@ -42,9 +50,34 @@ PyObject* pyCalcReplayGain(PyObject* self, PyObject* args, PyObject* kws);
 #include "SampleType.hpp"
 #include "LinkedList.hpp"
 #include "PlayerInStream.hpp"
+#include "PlayerStats.hpp"
 
 #include <memory>
 #include <atomic>
+#include <vector>
+
+
+#define PEEKSTREAM_NUM	10 // default for PlayerObject::peekStreamNum
+#define PEEKDECODE_NICE	5 // default for PlayerObject::peekDecodeNice
+#define OUT_LATENCY_MS	20 // default for PlayerObject::outLatencyMs, see OutStream::open()
+#define OUT_LATENCY_MAX_MS	200 // default for PlayerObject::outLatencyMaxMs
+#define OUT_BLOCK_MS	20 // default for PlayerObject::outBlockMs
+
+
+// A callback like onSongChange, see musicplayer_player_events.cpp.
+// It holds own references to the songs.
+struct PlayerEvent {
+	enum Type { SongChange, SongFinished, PlayingStateChange };
+	Type type;
+	PyObject* oldSong; // SongChange
+	PyObject* song; // SongChange: newSong, SongFinished: the finished song
+	bool skipped, errorOnOpening; // SongChange
+	bool oldState, newState; // PlayingStateChange
+	double finalTimePos; // SongFinished
+	PlayerEvent(Type _type = SongChange)
+	: type(_type), oldSong(NULL), song(NULL), skipped(false), errorOnOpening(false),
+	oldState(false), newState(false), finalTimePos(0) {}
+};
 
 
 // The player structure. Create by ffmpeg.createPlayer().
@@ -64,6 +97,7 @@ struct PlayerObject {
 	bool openOutStream();
 	bool isOutStreamOpen();
 	void closeOutStream(bool waitForPendingAudioBuffers);
+	void waitOutStreamOpening(); // see outStreamOpening. we expect to hold the player lock
 	std::string getSoundDevice();
 	float volume;
 	SmoothClipCalc volumeSmoothClip; // see smoothClip()
@@ -75,12 +109,80 @@ struct PlayerObject {
 	double timeDelay(size_t sampleNum) { return double(sampleNum)/outSamplerate/outNumChannels; }
 	Fader fader;
 	std::atomic<bool> outOfSync; // for readOutStream
+	double syncStartTime; // when readOutStream() noticed outOfSync, 0 if in sync
+	std::atomic<double> timeToFirstSample; // how long the last outOfSync lasted until we played again
+	size_t historyBufferSize; // per song, already played data kept for backward seeks. 0 disables it
+	// How PlayerInStream reads songs where song.url is a local file.
+	// By default, and for all other songs, we use song.readPacket/seekRaw.
+	enum FileIo {
+		FileIo_Python,
+		FileIo_ReadAhead, // ReadAheadFile
+		FileIo_Mmap, // MmapFile
+	};
+	FileIo fileIo;
+	// If > 0, a mixer thread calls readOutStream() that much ahead into a ring and
+	// the audio callback only copies from there. Thus variable costs in readOutStream()
+	// (fader, volume, song switches) can't cause an underrun. Used when the output is opened.
+	int mixAheadMs;
+	// player.outputMode: The PortAudio callback (default), or the blocking interface where
+	// our own audio thread writes blocks of outBlockMs. Used when the output is opened.
+	bool outBlocking;
+	int outBlockMs;
+	std::atomic<uint64_t> mixerUnderruns; // audio callback found the mixer ring empty
+	// Set on seeks, skips and play/pause. The audio callback then drops what the mixer
+	// rendered ahead, so that we don't play up to mixAheadMs of the old state.
+	std::atomic<bool> mixerResync;
+	// The suggested latency of the output stream. With adaptiveLatency, the worker raises
+	// it (up to outLatencyMaxMs) after underflows and lowers it again (down to outLatencyMs)
+	// after a while without any, see adaptOutLatency(). Covered by the player lock.
+	int outLatencyMs;
+	int outLatencyMaxMs;
+	bool adaptiveLatency;
+	int outLatencyCurMs; // what we use for the next open
+	struct LatencyDecision {
+		double time; // monotonicTime()
+		int oldMs, newMs;
+		const char* reason;
+	};
+	std::vector<LatencyDecision> latencyDecisions; // the last few
+	double latencyLastCheck, latencyLastRaise; // only used by the worker
+	uint64_t latencyUnderflowsSeen, latencySlowCallbacksSeen; // only used by the worker
+	std::atomic<uint64_t> outUnderflows; // paOutputUnderflow
+	std::atomic<uint64_t> outSlowCallbacks; // the callback took most of the buffer time
+	std::atomic<double> outActualLatency; // reported by PortAudio, in secs
+	void adaptOutLatency(); // we expect to not hold the player lock
+	PyObject* outLatencyStats(); // new dict. we expect to hold the GIL
+	PlayerStats stats;
+	PyObject* statsSnapshot(); // player.stats, new dict. we expect to hold the GIL
 	
 	// private
 	PyObject* dict;
 
 	bool nextSongOnEof;
 	bool skipPyExceptions; // for all callbacks, mainly song.readPacket
+	// Fast start: open the sound device without the player lock, so that the worker can open
+	// and decode the first song meanwhile. Open the peek streams only after the pre-roll.
+	// Also don't reinit PortAudio (which rescans the devices) for every output stream.
+	bool fastStart;
+	bool peekInStreamsPending; // with fastStart, the worker opens them once the current song can play
+	// How many songs we query from peekQueue. Only the first few get an opened and
+	// partly decoded PlayerInStream, the others are just probed and read ahead.
+	int peekStreamNum;
+	// Set by setPeekSongs(), a tuple. If set, we use it instead of peekQueue.
+	PyObject* peekSongs;
+	std::atomic<unsigned long> peekSongsVersion; // incremented by setPeekSongs()
+	unsigned long peekSongsReconciledVersion; // what openPeekInStreams() used last
+	// If enabled, the callbacks (onSongChange, onSongFinished, onPlayingStateChange)
+	// are called from a separate thread and redundant events are coalesced.
+	// Thus a slow handler does not stall the decoding.
+	bool asyncEvents;
+	void pushEvent(PlayerEvent ev); // takes over the references in ev
+	bool dispatchEvents(); // returns true if there were any events
+	void clearEvents(); // we expect to hold the GIL
+	void eventThreadProc(std::atomic<bool>& stopSignal);
+	PyThread eventThread;
+	LinkedList<PlayerEvent> events;
+	PyMutex eventsPushLock; // LinkedList::push_back() supports only a single producer
 	
 	void seekSong(double pos, bool relativePos);
 	bool getNextSong(bool skipped, bool maybeFade);
@@ -88,12 +190,39 @@ struct PlayerObject {
 	void workerProc(std::atomic<bool>& stopSignal);
 	PyThread workerThread;
 	void startWorkerThread();
+	// Reads the packets of all opened inStreams ahead, see PlayerInStream::packets.
+	void demuxProc(std::atomic<bool>& stopSignal);
+	PyThread demuxThread;
+	// Decodes the heads of the peek streams, with a lower priority than the worker.
+	void peekDecodeProc(std::atomic<bool>& stopSignal);
+	PyThread peekDecodeThread;
+	// Probes the peek songs which are not decoded, see warmupPeekSong().
+	void warmupProc(std::atomic<bool>& stopSignal);
+	PyThread warmupThread;
+	PyMutex warmupLock; // covers pendingWarmupUrls. Lock order: player lock, warmupLock.
+	std::vector<std::string> pendingWarmupUrls; // replaced by each openPeekInStreams()
+	// The demux and peek decode threads sleep while they have nothing to do.
+	// Call this when the inStreams or their state change, e.g. after open,
+	// seek or when a stream hit the end.
+	void wakeDecodeThreads();
+	// Scheduling of the worker, demux, peek decode and warmup threads (Linux only).
+	// The threads apply it themselves, see applyDecodeThreadScheduling().
+	std::vector<int> decodeCpuAffinity; // empty means all CPUs. covered by the player lock
+	int peekDecodeNice; // nice value of the peek decode and warmup threads, relative to the worker. covered by the player lock
+	std::atomic<int> decodeSchedulingVersion; // incremented when the above change
+	struct DecodeThreadScheduling {
+		int appliedVersion;
+		int baseNice;
+		DecodeThreadScheduling();
+	};
+	void applyDecodeThreadScheduling(const char* thread, bool usePeekDecodeNice, DecodeThreadScheduling& state);
 	
 	typedef LinkedList<PlayerInStream> InStreams;
 	InStreams inStreams;
 	bool openInStream();
 	bool tryOvertakePeekInStream();
 	void openPeekInStreams();
+	void openPeekInStreamsOrDefer();
 	bool isInStreamOpened() const; // in case we hit EOF, it is still opened
 	InStreams::ItemPtr getInStream() const; // old interface
 	Buffer* inStreamBuffer();
@@ -103,6 +232,7 @@ struct PlayerObject {
 	double curSongPos() const;
 	double curSongLen() const;
 	float curSongGainFactor() const;
+	PyObject* curSongPacketStats() const; // new dict. we expect to hold the GIL
 	
 	// returns the data read by the inStream.
 	// if sampleNumOut==NULL, it will fill the requested samples with silence.
@@ -115,6 +245,29 @@ struct PlayerObject {
 	
 	struct OutStream;
 	std::shared_ptr<OutStream> outStream;
+
+	// A native thread which pulls readOutStream() instead of the sound card,
+	// see musicplayer_player_sinks.cpp.
+	struct Sink {
+		PlayerObject* const player;
+		PyThread thread; // the subclass must stop it in its destructor
+		std::atomic<uint64_t> blocks, frames, underruns, lateBlocks;
+		std::atomic<double> startTime, busySecs, maxBlockSecs;
+		Sink(PlayerObject* p);
+		virtual ~Sink() {}
+		virtual const char* type() const = 0;
+		virtual void proc(std::atomic<bool>& stopSignal) = 0;
+		virtual bool addStats(PyObject* dict) { return true; } // we expect to hold the GIL
+		void recordBlock(size_t frameNum, double secs, bool underrun, bool late);
+		PyObject* stats(); // new dict. we expect to hold the GIL
+	};
+	std::shared_ptr<Sink> sink, lastSink; // covered by the player lock
+	bool startSink(std::shared_ptr<Sink> newSink);
+	void stopSink();
+	bool startVirtualSink(double speed, size_t blockFrames);
+	// If filename is empty, we write to fd, which is not closed by us.
+	bool startRenderSink(const std::string& filename, int fd, bool wav, size_t blockFrames, double maxSecs, double idleTimeoutSecs);
+	PyObject* sinkStats(); // we expect to hold the GIL
 		
 	/* Important note about the lock:
 	 To avoid deadlocks with on thread waiting on the Python GIL and another on this lock,
@@ -140,6 +293,7 @@ struct PlayerObject {
 	// So while we hold the player lock, these can not be enabled from somewhere else.
 	// These can be disabled though in unlocked scope.
 	std::atomic<bool> pyQueueLock; // This covers anything which would potentially modifiy `queue` or `peekQueue`.
+	std::atomic<bool> outStreamOpening; // With fastStart, while setPlaying() opens the sound device unlocked, or adaptOutLatency() reopens it. Everyone else who opens, closes or resets outStream waits for it, see waitOutStreamOpening().
 	std::atomic<bool> openStreamLock; // This covers the opening of a PlayerInStream. (Only because of FFmpeg issues. Maybe should be global. Should not be needed theoretically if FFmpeg would be safe.)
 };
 
@@ -7,6 +7,9 @@
 #include "musicplayer.h"
 #include "Py3Compat.h"
 #include <chromaprint.h>
+#include <algorithm>
+#include <vector>
+#include <string>
 
 PyObject *
 pyCalcAcoustIdFingerprint(PyObject* self, PyObject* args) {
@@ -107,3 +110,189 @@ final:
 	Py_XDECREF(player);
 	return returnObj;
 }
+
+
+#ifdef CHROMAPRINT_HAVE_BATCH_CODEC
+static int encodeFingerprints(const void* const* fps, const int* sizes, int count, int algorithm, void** encoded, int* offsets, int base64) {
+	return chromaprint_encode_fingerprints(fps, sizes, count, algorithm, encoded, offsets, base64);
+}
+
+static int decodeFingerprints(const void* const* encodedFps, const int* encodedSizes, int count, void** fps, int* offsets, int* algorithms, int base64) {
+	return chromaprint_decode_fingerprints(encodedFps, encodedSizes, count, fps, offsets, algorithms, base64);
+}
+#else
+// The system Chromaprint doesn't have the batch codec (only our bundled one has,
+// which only the MacOSX qmake build and compile.py with StaticChromaprint use).
+// Provide the same interface on top of the single fingerprint functions.
+// Like the bundled one, an invalid fingerprint is decoded as an empty one
+// with algorithm -1 and does not fail the whole batch.
+
+static int encodeFingerprints(const void* const* fps, const int* sizes, int count, int algorithm, void** encoded, int* offsets, int base64) {
+	std::string result;
+	for(int i = 0; i < count; ++i) {
+		offsets[i] = (int) result.size();
+		void* fp = NULL;
+		int size = 0;
+		if(!chromaprint_encode_fingerprint((void*) fps[i], sizes[i], algorithm, &fp, &size, base64))
+			return 0;
+		result.append((const char*) fp, size);
+		chromaprint_dealloc(fp);
+	}
+	offsets[count] = (int) result.size();
+	*encoded = malloc(result.size() + 1);
+	if(!*encoded) return 0;
+	memcpy(*encoded, result.data(), result.size());
+	return 1;
+}
+
+static int decodeFingerprints(const void* const* encodedFps, const int* encodedSizes, int count, void** fps, int* offsets, int* algorithms, int base64) {
+	std::vector<int32_t> result;
+	for(int i = 0; i < count; ++i) {
+		offsets[i] = (int) result.size();
+		algorithms[i] = -1;
+		// Shorter than the 4 byte header. Some Chromaprint versions don't check that.
+		if(encodedSizes[i] < (base64 ? 6 : 4))
+			continue;
+		void* fp = NULL;
+		int size = 0;
+		int algorithm = -1;
+		if(!chromaprint_decode_fingerprint((void*) encodedFps[i], encodedSizes[i], &fp, &size, &algorithm, base64)) {
+			if(fp) chromaprint_dealloc(fp);
+			continue;
+		}
+		algorithms[i] = algorithm;
+		result.insert(result.end(), (int32_t*) fp, (int32_t*) fp + size);
+		chromaprint_dealloc(fp);
+	}
+	offsets[count] = (int) result.size();
+	*fps = malloc(sizeof(int32_t) * std::max(result.size(), (size_t) 1));
+	if(!*fps) return 0;
+	memcpy(*fps, result.data(), sizeof(int32_t) * result.size());
+	return 1;
+}
+#endif
+
+// Holds buffer views of all items of a Python sequence.
+// Unicode strings are accepted as well, we use their UTF8 encoding.
+struct PyBufferList {
+	std::vector<Py_buffer> views;
+	std::vector<PyObject*> owned; // UTF8 encoded unicode objects
+	std::vector<const void*> ptrs;
+	std::vector<int> sizes;
+	~PyBufferList() {
+		for(Py_buffer& view : views)
+			PyBuffer_Release(&view);
+		for(PyObject* obj : owned)
+			Py_DECREF(obj);
+	}
+	bool init(PyObject* seqObj, const char* name, size_t itemSize) {
+		PyObject* seq = PySequence_Fast(seqObj, name);
+		if(!seq) return false;
+		Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+		views.reserve(count);
+		ptrs.reserve(count);
+		sizes.reserve(count);
+		for(Py_ssize_t i = 0; i < count; ++i) {
+			PyObject* item = PySequence_Fast_GET_ITEM(seq, i);
+			if(PyUnicode_Check(item)) {
+				item = PyUnicode_AsUTF8String(item);
+				if(!item) break;
+				owned.push_back(item);
+			}
+			Py_buffer view;
+			if(PyObject_GetBuffer(item, &view, PyBUF_SIMPLE) != 0) break;
+			views.push_back(view);
+			if(view.len % itemSize != 0) {
+				PyErr_Format(PyExc_ValueError, "%s: item %i has invalid size %i", name, (int) i, (int) view.len);
+				break;
+			}
+			ptrs.push_back(view.buf);
+			sizes.push_back((int) (view.len / itemSize));
+		}
+		Py_DECREF(seq);
+		return !PyErr_Occurred();
+	}
+};
+
+PyObject *
+pyEncodeAcoustIdFingerprints(PyObject* self, PyObject* args, PyObject* kws) {
+	PyObject* fpsObj = NULL;
+	int algorithm = CHROMAPRINT_ALGORITHM_DEFAULT;
+	int base64 = 1;
+	static const char *kwlist[] = {"fingerprints", "algorithm", "base64", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kws, "O|ii:encodeAcoustIdFingerprints", (char**)kwlist, &fpsObj, &algorithm, &base64))
+		return NULL;
+
+	PyBufferList fps;
+	if(!fps.init(fpsObj, "encodeAcoustIdFingerprints: fingerprints", sizeof(int32_t)))
+		return NULL;
+
+	int count = (int) fps.ptrs.size();
+	std::vector<int> offsets(count + 1);
+	void* encoded = NULL;
+	int ret = 0;
+	Py_BEGIN_ALLOW_THREADS
+	ret = encodeFingerprints(fps.ptrs.data(), fps.sizes.data(), count, algorithm, &encoded, offsets.data(), base64);
+	Py_END_ALLOW_THREADS
+	if(!ret) {
+		PyErr_SetString(PyExc_RuntimeError, "encodeAcoustIdFingerprints: encoding failed");
+		if(encoded) chromaprint_dealloc(encoded);
+		return NULL;
+	}
+
+	PyObject* returnObj = PyList_New(count);
+	for(int i = 0; returnObj && i < count; ++i) {
+		PyObject* item = PyBytes_FromStringAndSize((const char*) encoded + offsets[i], offsets[i + 1] - offsets[i]);
+		if(!item) {
+			Py_CLEAR(returnObj);
+			break;
+		}
+		PyList_SET_ITEM(returnObj, i, item);
+	}
+	chromaprint_dealloc(encoded);
+	return returnObj;
+}
+
+PyObject *
+pyDecodeAcoustIdFingerprints(PyObject* self, PyObject* args, PyObject* kws) {
+	PyObject* fpsObj = NULL;
+	int base64 = 1;
+	static const char *kwlist[] = {"fingerprints", "base64", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kws, "O|i:decodeAcoustIdFingerprints", (char**)kwlist, &fpsObj, &base64))
+		return NULL;
+
+	PyBufferList encodedFps;
+	if(!encodedFps.init(fpsObj, "decodeAcoustIdFingerprints: fingerprints", 1))
+		return NULL;
+
+	int count = (int) encodedFps.ptrs.size();
+	std::vector<int> offsets(count + 1);
+	std::vector<int> algorithms(count);
+	void* fps = NULL;
+	int ret = 0;
+	Py_BEGIN_ALLOW_THREADS
+	ret = decodeFingerprints(encodedFps.ptrs.data(), encodedFps.sizes.data(), count, &fps, offsets.data(), algorithms.data(), base64);
+	Py_END_ALLOW_THREADS
+	if(!ret) {
+		PyErr_SetString(PyExc_RuntimeError, "decodeAcoustIdFingerprints: decoding failed");
+		if(fps) chromaprint_dealloc(fps);
+		return NULL;
+	}
+
+	// Each raw fingerprint is returned as bytes of native int32 values,
+	// e.g. usable via numpy.frombuffer(fp, dtype="int32") or array.array("i", fp).
+	PyObject* returnObj = PyList_New(count);
+	for(int i = 0; returnObj && i < count; ++i) {
+		PyObject* fp = PyBytes_FromStringAndSize(
+			(const char*) ((int32_t*) fps + offsets[i]),
+			(offsets[i + 1] - offsets[i]) * sizeof(int32_t));
+		PyObject* item = fp ? Py_BuildValue("(iN)", algorithms[i], fp) : NULL;
+		if(!item) {
+			Py_CLEAR(returnObj);
+			break;
+		}
+		PyList_SET_ITEM(returnObj, i, item);
+	}
+	chromaprint_dealloc(fps);
+	return returnObj;
+}
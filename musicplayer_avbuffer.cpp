@@ -0,0 +1,124 @@
+// Python buffer object for FFmpeg owned memory
+// part of MusicPlayer, https://github.com/albertz/music-player
+// Copyright (c) 2012, Albert Zeyer, www.az2000.de
+// All rights reserved.
+// This code is under the 2-clause BSD license, see License.txt in the root directory of this project.
+
+// This wraps an AVPacket or an av_malloc'ed block and exposes it via the
+// buffer protocol (read-only), so e.g. cover art can be handed to Python
+// without copying. Use memoryview(obj) or bytes(obj) on the Python side.
+
+#include "musicplayer.h"
+#include "Py3Compat.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(55,16,0)
+#define av_packet_unref av_free_packet
+#endif
+
+struct AVBufferObject {
+	PyObject_HEAD
+	AVPacket pkt; // if pkt.data is set, data points into it
+	uint8_t* data;
+	Py_ssize_t size;
+};
+
+static void avbuffer_dealloc(PyObject* obj) {
+	AVBufferObject* buf = (AVBufferObject*) obj;
+	if(buf->pkt.data)
+		av_packet_unref(&buf->pkt);
+	else if(buf->data)
+		av_free(buf->data);
+	buf->data = NULL;
+	Py_TYPE(obj)->tp_free(obj);
+}
+
+static int avbuffer_getbuffer(PyObject* obj, Py_buffer* view, int flags) {
+	AVBufferObject* buf = (AVBufferObject*) obj;
+	return PyBuffer_FillInfo(view, obj, buf->data, buf->size, 1 /* readonly */, flags);
+}
+
+static Py_ssize_t avbuffer_len(PyObject* obj) {
+	return ((AVBufferObject*) obj)->size;
+}
+
+static PySequenceMethods avbuffer_as_sequence = {
+	avbuffer_len, // sq_length
+};
+
+static PyBufferProcs avbuffer_as_buffer = {
+#if PY_MAJOR_VERSION == 2
+	0, // bf_getreadbuffer
+	0, // bf_getwritebuffer
+	0, // bf_getsegcount
+	0, // bf_getcharbuffer
+#endif
+	avbuffer_getbuffer, // bf_getbuffer
+	0, // bf_releasebuffer
+};
+
+#if PY_MAJOR_VERSION == 2
+#define AVBUFFER_TPFLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER)
+#else
+#define AVBUFFER_TPFLAGS Py_TPFLAGS_DEFAULT
+#endif
+
+PyTypeObject AVBuffer_Type = {
+	PyVarObject_HEAD_INIT(&PyType_Type, 0)
+	"AVBuffer",
+	sizeof(AVBufferObject),	// basicsize
+	0,	// itemsize
+	avbuffer_dealloc,	/*tp_dealloc*/
+	0,                  /*tp_print*/
+	0,					/*tp_getattr*/
+	0,					/*tp_setattr*/
+	0,                  /*tp_compare*/
+	0,					/*tp_repr*/
+	0,                  /*tp_as_number*/
+	&avbuffer_as_sequence, /*tp_as_sequence*/
+	0,                  /*tp_as_mapping*/
+	0,					/*tp_hash */
+	0, // tp_call
+	0, // tp_str
+	0, // tp_getattro
+	0, // tp_setattro
+	&avbuffer_as_buffer, // tp_as_buffer
+	AVBUFFER_TPFLAGS, // flags
+	"read-only buffer with FFmpeg owned data", // doc
+};
+
+static AVBufferObject* newAVBuffer() {
+	AVBufferObject* buf = PyObject_New(AVBufferObject, &AVBuffer_Type);
+	if(!buf) return NULL;
+	memset(&buf->pkt, 0, sizeof(buf->pkt));
+	buf->data = NULL;
+	buf->size = 0;
+	return buf;
+}
+
+PyObject* newAVBufferFromPacket(AVPacket* pkt) {
+	AVBufferObject* buf = newAVBuffer();
+	if(!buf) {
+		av_packet_unref(pkt);
+		return NULL;
+	}
+	buf->pkt = *pkt;
+	memset(pkt, 0, sizeof(*pkt));
+	buf->data = buf->pkt.data;
+	buf->size = buf->pkt.size;
+	return (PyObject*) buf;
+}
+
+PyObject* newAVBufferFromData(uint8_t* data, size_t size) {
+	AVBufferObject* buf = newAVBuffer();
+	if(!buf) {
+		av_free(data);
+		return NULL;
+	}
+	buf->data = data;
+	buf->size = size;
+	return (PyObject*) buf;
+}
@@ -7,28 +7,124 @@
 // This code is under the 2-clause BSD license, see License.txt in the root directory of this project.
 
 #include "musicplayer.h"
+#include "PyUtils.h"
+#include "Py3Compat.h"
+#include <vector>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <unistd.h>
+
+#define METADATA_MAX_THREADS 32
 
 PyObject*
-pyGetMetadata(PyObject* self, PyObject* args) {
+pyGetMetadata(PyObject* self, PyObject* args, PyObject* kws) {
 	PyObject* songObj = NULL;
-	if(!PyArg_ParseTuple(args, "O:getMetadata", &songObj))
+	unsigned char coverArt = 0;
+	int thumbnailSize = 0;
+	static const char *kwlist[] = {"song", "coverArt", "thumbnailSize", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kws, "O|bi:getMetadata", (char**)kwlist, &songObj, &coverArt, &thumbnailSize))
 		return NULL;
-	
+
+	std::string url = songUrl(songObj);
 	PyObject* returnObj = NULL;
-	PlayerObject* player = (PlayerObject*) pyCreatePlayer(NULL);
-	if(!player) goto final;
-	player->lock.enabled = false;
-	player->nextSongOnEof = false;
-	player->skipPyExceptions = false;
 	Py_INCREF(songObj);
-	player->curSong = songObj;
-	player->openInStream();
-	if(PyErr_Occurred()) goto final;
-	
-	returnObj = player->curSongMetadata();
-	
-final:
-	Py_XINCREF(returnObj);
-	Py_XDECREF(player);
+	Py_BEGIN_ALLOW_THREADS
+	returnObj = readSongMetadata(songObj, url, false, coverArt, thumbnailSize);
+	Py_END_ALLOW_THREADS
+	Py_DECREF(songObj);
+
+	if(!returnObj && !PyErr_Occurred())
+		PyErr_SetString(PyExc_RuntimeError, "failed to open file");
+	if(returnObj && PyErr_Occurred()) {
+		Py_DECREF(returnObj);
+		returnObj = NULL;
+	}
+	return returnObj;
+}
+
+PyObject*
+pyGetMetadataBatch(PyObject* self, PyObject* args, PyObject* kws) {
+	PyObject* songsObj = NULL;
+	int numThreads = 0;
+	unsigned char coverArt = 0;
+	int thumbnailSize = 0;
+	static const char *kwlist[] = {"songs", "numThreads", "coverArt", "thumbnailSize", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kws, "O|ibi:getMetadataBatch", (char**)kwlist, &songsObj, &numThreads, &coverArt, &thumbnailSize))
+		return NULL;
+
+	PyObject* songs = PySequence_Fast(songsObj, "songs must be a sequence");
+	if(!songs) return NULL;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(songs);
+
+	// Filenames are read directly, without Python. Song objects use readPacket/seekRaw.
+	// We own references to them, because the caller might modify the list meanwhile.
+	std::vector<PyObject*> songObjs(count, (PyObject*) NULL);
+	std::vector<std::string> urls(count);
+	for(Py_ssize_t i = 0; i < count; ++i) {
+		PyObject* item = PySequence_Fast_GET_ITEM(songs, i);
+		if(PyUnicode_Check(item) || PyBytes_Check(item)) {
+			if(!pyStr(item, urls[i])) {
+				for(PyObject* songObj : songObjs)
+					Py_XDECREF(songObj);
+				Py_DECREF(songs);
+				return NULL;
+			}
+		}
+		else {
+			Py_INCREF(item);
+			songObjs[i] = item;
+			urls[i] = songUrl(item);
+		}
+	}
+
+	if(numThreads <= 0)
+		numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if(numThreads > METADATA_MAX_THREADS)
+		numThreads = METADATA_MAX_THREADS;
+	if(numThreads > count)
+		numThreads = (int) count;
+	if(numThreads < 1)
+		numThreads = 1;
+
+	std::vector<PyObject*> results(count, (PyObject*) NULL);
+	std::atomic<Py_ssize_t> nextIndex(0);
+	auto worker = [&](std::atomic<bool>& stopSignal) {
+		while(!stopSignal) {
+			Py_ssize_t i = nextIndex++;
+			if(i >= count) break;
+			results[i] = readSongMetadata(songObjs[i], urls[i], true, coverArt, thumbnailSize);
+		}
+	};
+
+	Py_BEGIN_ALLOW_THREADS
+	std::vector<std::unique_ptr<PyThread>> threads;
+	for(int t = 1; t < numThreads; ++t) {
+		threads.emplace_back(new PyThread());
+		threads.back()->func = worker;
+		if(!threads.back()->start())
+			threads.pop_back(); // the remaining threads will do the work
+	}
+	std::atomic<bool> noStop(false);
+	worker(noStop);
+	for(auto& thread : threads)
+		thread->wait();
+	Py_END_ALLOW_THREADS
+
+	for(PyObject* songObj : songObjs)
+		Py_XDECREF(songObj);
+	Py_DECREF(songs);
+	PyObject* returnObj = PyList_New(count);
+	for(Py_ssize_t i = 0; i < count; ++i) {
+		PyObject* item = results[i];
+		if(!item) {
+			item = Py_None;
+			Py_INCREF(item);
+		}
+		if(returnObj)
+			PyList_SET_ITEM(returnObj, i, item);
+		else
+			Py_DECREF(item);
+	}
 	return returnObj;
 }
@@ -23,6 +23,9 @@ bool PlayerObject::getNextSong(bool skipped, bool maybeFade) {
 
 	// We must hold the player lock here.
 
+	if(skipped)
+		mixerResync = true;
+
 	if(maybeFade) {
 		InStreams::ItemPtr isptr = player->getInStream();
 		if(isptr.get()) {
@@ -43,10 +46,13 @@ bool PlayerObject::getNextSong(bool skipped, bool maybeFade) {
 	if(skipped)
 		outOfSync = true;
 
+	LockProfilerSpinWait spinWait("pyQueueLock");
 	while(pyQueueLock) {
+		spinWait.spin();
 		PyScopedUnlock unlock(this->lock);
 		usleep(100);
 	}
+	spinWait.finish();
 	pyQueueLock = true;
 
 	bool ret = false;
@@ -97,30 +103,17 @@ bool PlayerObject::getNextSong(bool skipped, bool maybeFade) {
 
 	// make callback onSongChange
 	if(player->dict) {
-		PyScopedGIL gstate;
-
-		PyObject* onSongChange = PyDict_GetItemString(player->dict, "onSongChange");
-		if(onSongChange && onSongChange != Py_None) {
-			PyObject* kwargs = PyDict_New();
-			assert(kwargs);
-			if(oldSong)
-				PyDict_SetItemString(kwargs, "oldSong", oldSong);
-			else
-				PyDict_SetItemString(kwargs, "oldSong", Py_None);
-			PyDict_SetItemString(kwargs, "newSong", player->curSong);
-			PyDict_SetItemString_retain(kwargs, "skipped", PyBool_FromLong(skipped));
-			PyDict_SetItemString_retain(kwargs, "errorOnOpening", PyBool_FromLong(errorOnOpening));
-
-			PyObject* retObj = PyEval_CallObjectWithKeywords(onSongChange, NULL, kwargs);
-			Py_XDECREF(retObj);
-
-			// errors are not fatal from the callback, so handle it now and go on
-			if(PyErr_Occurred()) {
-				PyErr_Print(); // prints traceback to stderr, resets error indicator. also handles sys.excepthook if it is set (see pythonrun.c, it's not said explicitely in the docs)
-			}
-
-			Py_DECREF(kwargs);
+		PlayerEvent ev(PlayerEvent::SongChange);
+		{
+			PyScopedGIL gstate;
+			ev.oldSong = oldSong;
+			Py_XINCREF(ev.oldSong);
+			ev.song = player->curSong;
+			Py_XINCREF(ev.song);
 		}
+		ev.skipped = skipped;
+		ev.errorOnOpening = errorOnOpening;
+		player->pushEvent(ev);
 	}
 
 final:
@@ -132,7 +125,7 @@ final:
 	pyQueueLock = false;
 
 	if(ret && nextSongOnEof)
-		openPeekInStreams();
+		openPeekInStreamsOrDefer();
 	return ret;
 }
 
@@ -220,6 +213,16 @@ int player_init(PyObject* self, PyObject* args, PyObject* kwds) {
 	player->outOfSync = true;
 
 	player->openStreamLock = player->pyQueueLock = false;
+	player->outStreamOpening = false;
+	player->peekStreamNum = PEEKSTREAM_NUM;
+	player->mixAheadMs = 0;
+	player->mixerUnderruns = 0;
+	player->mixerResync = false;
+	player->outLatencyMs = player->outLatencyCurMs = OUT_LATENCY_MS;
+	player->outLatencyMaxMs = OUT_LATENCY_MAX_MS;
+	player->outBlockMs = OUT_BLOCK_MS;
+	player->outUnderflows = player->outSlowCallbacks = 0;
+	player->outActualLatency = 0;
 
 	{
 		// We have the Python GIL here. For setAudioTgt, we need the Player lock.
@@ -231,6 +234,11 @@ int player_init(PyObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	player->workerThread.func = boost::bind(&PlayerObject::workerProc, player, _1);
+	player->demuxThread.func = boost::bind(&PlayerObject::demuxProc, player, _1);
+	player->peekDecodeThread.func = boost::bind(&PlayerObject::peekDecodeProc, player, _1);
+	player->warmupThread.func = boost::bind(&PlayerObject::warmupProc, player, _1);
+	player->peekDecodeNice = PEEKDECODE_NICE;
+	player->eventThread.func = boost::bind(&PlayerObject::eventThreadProc, player, _1);
 
 	return 0;
 }
@@ -243,11 +251,19 @@ void player_dealloc(PyObject* obj) {
 	// first, destroy any non-python threads
 	Py_BEGIN_ALLOW_THREADS
 	{
+		if(player->sink) player->sink->thread.stop();
 		player->workerThread.stop();
+		player->demuxThread.stop();
+		player->peekDecodeThread.stop();
+		player->warmupThread.stop();
 		player->outStream.reset();
+		player->eventThread.stop();
 	}
 	Py_END_ALLOW_THREADS
 
+	// Not delivered anymore, just release the songs.
+	player->clearEvents();
+
 	{
 		// we don't need a lock because in dealloc, we have the only ref to this PlayerObject.
 		// also, we must not lock it here because we cannot free inStream otherwise.
@@ -265,6 +281,9 @@ void player_dealloc(PyObject* obj) {
 
 		Py_XDECREF(player->peekQueue);
 		player->peekQueue = NULL;
+
+		Py_XDECREF(player->peekSongs);
+		player->peekSongs = NULL;
 	}
 
 	player->~PlayerObject();
@@ -273,6 +292,7 @@ void player_dealloc(PyObject* obj) {
 
 
 void PlayerObject::setAudioTgt(int samplerate, int numchannels) {
+	waitOutStreamOpening(); // this releases the lock, thus first
 	if(this->playing) return;
 
 	// TODO: error checkking for samplerate or numchannels?
@@ -390,6 +410,38 @@ static PyMethodDef md_reloadPeekStreams = {
 	NULL
 };
 
+static
+PyObject* player_method_setPeekSongs(PyObject* self, PyObject* arg) {
+	PlayerObject* player = (PlayerObject*) self;
+	PyObject* songs = NULL; // None means that we use peekQueue again
+	if(arg != Py_None) {
+		songs = PySequence_Tuple(arg);
+		if(!songs) return NULL;
+	}
+	PyObject* oldSongs = NULL;
+	Py_INCREF(self);
+	Py_BEGIN_ALLOW_THREADS
+	{
+		// The worker will reconcile the peek streams.
+		PyScopedLock lock(player->lock);
+		oldSongs = player->peekSongs;
+		player->peekSongs = songs;
+		player->peekSongsVersion++;
+	}
+	Py_END_ALLOW_THREADS
+	Py_XDECREF(oldSongs);
+	Py_DECREF(self);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyMethodDef md_setPeekSongs = {
+	"setPeekSongs",
+	player_method_setPeekSongs,
+	METH_O,
+	NULL
+};
+
 
 static
 PyObject* player_method_startWorkerThread(PyObject* self, PyObject* _unused_arg) {
@@ -459,6 +511,160 @@ static PyMethodDef md_readOutStream = {
 	NULL
 };
 
+// Like readOutStream, but fills a writable buffer (e.g. bytearray or numpy array)
+// instead of allocating a new bytes object. Returns the number of samples written.
+static
+PyObject* player_method_readOutStreamInto(PyObject* self, PyObject* arg) {
+	PlayerObject* player = (PlayerObject*) self;
+
+	if(player->soundcardOutputEnabled) {
+		PyErr_SetString(PyExc_RuntimeError, "cannot use readOutStreamInto with soundcardOutputEnabled");
+		return NULL;
+	}
+
+	if(!player->playing) {
+		PyErr_SetString(PyExc_RuntimeError, "cannot use readOutStreamInto while not playing");
+		return NULL;
+	}
+
+	Py_buffer view;
+	if(PyObject_GetBuffer(arg, &view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) != 0)
+		return NULL;
+	size_t num = view.len / OUTSAMPLEBYTELEN;
+	size_t sampleOutNum = 0;
+
+	Py_INCREF(self);
+	Py_BEGIN_ALLOW_THREADS
+	{
+		PyScopedLock lock(player->lock);
+		player->readOutStream((OUTSAMPLE_t*)view.buf, num, &sampleOutNum);
+	}
+	Py_END_ALLOW_THREADS
+	Py_DECREF(self);
+
+	PyBuffer_Release(&view);
+	return PyLong_FromSize_t(sampleOutNum);
+}
+
+static PyMethodDef md_readOutStreamInto = {
+	"readOutStreamInto",
+	player_method_readOutStreamInto,
+	METH_O,
+	NULL
+};
+
+
+static
+PyObject* player_method_startVirtualSink(PyObject* self, PyObject* args, PyObject* kws) {
+	PlayerObject* player = (PlayerObject*) self;
+
+	double speed = 1;
+	int blockFrames = 1024;
+	static const char *kwlist[] = {"speed", "blockFrames", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kws, "|di:startVirtualSink", (char**)kwlist, &speed, &blockFrames))
+		return NULL;
+	if(blockFrames <= 0) {
+		PyErr_SetString(PyExc_ValueError, "blockFrames must be > 0");
+		return NULL;
+	}
+
+	bool ok = false;
+	Py_INCREF(self);
+	Py_BEGIN_ALLOW_THREADS
+	{
+		PyScopedLock lock(player->lock);
+		ok = player->startVirtualSink(speed, blockFrames);
+	}
+	Py_END_ALLOW_THREADS
+	Py_DECREF(self);
+	if(!ok) return NULL;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyMethodDef md_startVirtualSink = {
+	"startVirtualSink",
+	(PyCFunction) player_method_startVirtualSink,
+	METH_VARARGS|METH_KEYWORDS,
+	NULL
+};
+
+static
+PyObject* player_method_startRenderSink(PyObject* self, PyObject* args, PyObject* kws) {
+	PlayerObject* player = (PlayerObject*) self;
+
+	PyObject* fileObj = NULL;
+	const char* format = "wav";
+	int blockFrames = 65536;
+	double maxSecs = 0;
+	double idleTimeoutSecs = 5;
+	static const char *kwlist[] = {"file", "format", "blockFrames", "maxSecs", "idleTimeoutSecs", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kws, "O|sidd:startRenderSink", (char**)kwlist,
+									&fileObj, &format, &blockFrames, &maxSecs, &idleTimeoutSecs))
+		return NULL;
+
+	std::string filename;
+	int fd = -1;
+	if(PyInt_Check(fileObj) || PyLong_Check(fileObj)) {
+		fd = (int) PyInt_AsLong(fileObj);
+		if(PyErr_Occurred()) return NULL;
+	}
+	else if(!pyStr(fileObj, filename)) {
+		PyErr_SetString(PyExc_ValueError, "startRenderSink: file must be a filename or a fd");
+		return NULL;
+	}
+	bool wav = strcmp(format, "wav") == 0;
+	if(!wav && strcmp(format, "raw") != 0) {
+		PyErr_Format(PyExc_ValueError, "startRenderSink: format must be 'wav' or 'raw', got '%s'", format);
+		return NULL;
+	}
+	if(blockFrames <= 0) {
+		PyErr_SetString(PyExc_ValueError, "blockFrames must be > 0");
+		return NULL;
+	}
+
+	bool ok = false;
+	Py_INCREF(self);
+	Py_BEGIN_ALLOW_THREADS
+	{
+		PyScopedLock lock(player->lock);
+		ok = player->startRenderSink(filename, fd, wav, blockFrames, maxSecs, idleTimeoutSecs);
+	}
+	Py_END_ALLOW_THREADS
+	Py_DECREF(self);
+	if(!ok) return NULL;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyMethodDef md_startRenderSink = {
+	"startRenderSink",
+	(PyCFunction) player_method_startRenderSink,
+	METH_VARARGS|METH_KEYWORDS,
+	NULL
+};
+
+static
+PyObject* player_method_stopSink(PyObject* self, PyObject* _unused_arg) {
+	PlayerObject* player = (PlayerObject*) self;
+	Py_INCREF(self);
+	Py_BEGIN_ALLOW_THREADS
+	{
+		PyScopedLock lock(player->lock);
+		player->stopSink();
+	}
+	Py_END_ALLOW_THREADS
+	Py_DECREF(self);
+	// The final stats.
+	return player->sinkStats();
+}
+
+static PyMethodDef md_stopSink = {
+	"stopSink",
+	player_method_stopSink,
+	METH_NOARGS,
+	NULL
+};
 
 static
 PyObject* player_method_resetPlaying(PyObject* self, PyObject* _unused_arg) {
@@ -500,19 +706,31 @@ PyObject* player_getdict(PlayerObject* player) {
 		const char* attribs[] = {
 			"queue", "peekQueue",
 			"playing", "resetPlaying",
-			"curSong", "curSongPos", "curSongLen", "curSongMetadata", "curSongGainFactor",
+			"curSong", "curSongPos", "curSongLen", "curSongMetadata", "curSongGainFactor", "curSongPacketStats",
 			"seekAbs", "seekRel",
 			"nextSong",
-			"reloadPeekStreams",
+			"reloadPeekStreams", "setPeekSongs", "peekSongsVersion",
 			"startWorkerThread",
-			"readOutStream",
+			"readOutStream", "readOutStreamInto",
 			"volume",
 			"volumeSmoothClip",
 			"volumeAdjustEnabled",
 			"outSampleFormat", "outSamplerate", "outNumChannels",
 			"preferredSoundDevice", "actualSoundDevice",
 			"soundcardOutputEnabled",
-			"nextSongOnEof"
+			"nextSongOnEof",
+			"historyBufferSize",
+			"timeToFirstSample",
+			"fastStart",
+			"peekStreamNum",
+			"asyncEvents",
+			"fileIo",
+			"decodeCpuAffinity", "peekDecodeNice",
+			"mixAheadMs", "mixerUnderruns",
+			"outLatencyMs", "outLatencyMaxMs", "adaptiveLatency", "outLatencyStats",
+			"outputMode", "outBlockMs",
+			"startVirtualSink", "startRenderSink", "stopSink", "sinkStats",
+			"stats"
 		};
 		for(const char* attr : attribs)
 			PyDict_SetItemString(player->dict, attr, Py_None);
@@ -588,6 +806,10 @@ PyObject* player_getattr(PyObject* obj, char* key) {
 		goto returnNone;
 	}
 
+	if(strcmp(key, "curSongPacketStats") == 0) {
+		return player->curSongPacketStats();
+	}
+
 	if(strcmp(key, "curSongGainFactor") == 0) {
 		if(player->isInStreamOpened())
 			return PyFloat_FromDouble(player->curSongGainFactor());
@@ -610,6 +832,14 @@ PyObject* player_getattr(PyObject* obj, char* key) {
 		return PyCFunction_New(&md_reloadPeekStreams, (PyObject*) player);
 	}
 
+	if(strcmp(key, "setPeekSongs") == 0) {
+		return PyCFunction_New(&md_setPeekSongs, (PyObject*) player);
+	}
+
+	if(strcmp(key, "peekSongsVersion") == 0) {
+		return PyLong_FromUnsignedLong(player->peekSongsVersion);
+	}
+
 	if(strcmp(key, "startWorkerThread") == 0) {
 		return PyCFunction_New(&md_startWorkerThread, (PyObject*) player);
 	}
@@ -618,6 +848,10 @@ PyObject* player_getattr(PyObject* obj, char* key) {
 		return PyCFunction_New(&md_readOutStream, (PyObject*) player);
 	}
 
+	if(strcmp(key, "readOutStreamInto") == 0) {
+		return PyCFunction_New(&md_readOutStreamInto, (PyObject*) player);
+	}
+
 	if(strcmp(key, "volume") == 0) {
 		return PyFloat_FromDouble(player->volume);
 	}
@@ -664,6 +898,118 @@ PyObject* player_getattr(PyObject* obj, char* key) {
 		return PyBool_FromLong(player->nextSongOnEof);
 	}
 
+	if(strcmp(key, "historyBufferSize") == 0) {
+		return PyLong_FromSize_t(player->historyBufferSize);
+	}
+
+	if(strcmp(key, "timeToFirstSample") == 0) {
+		return PyFloat_FromDouble(player->timeToFirstSample);
+	}
+
+	if(strcmp(key, "fastStart") == 0) {
+		return PyBool_FromLong(player->fastStart);
+	}
+
+	if(strcmp(key, "peekStreamNum") == 0) {
+		return PyInt_FromLong(player->peekStreamNum);
+	}
+
+	if(strcmp(key, "mixAheadMs") == 0) {
+		return PyInt_FromLong(player->mixAheadMs);
+	}
+
+	if(strcmp(key, "mixerUnderruns") == 0) {
+		return PyLong_FromUnsignedLongLong(player->mixerUnderruns);
+	}
+
+	if(strcmp(key, "outLatencyMs") == 0) {
+		return PyInt_FromLong(player->outLatencyMs);
+	}
+
+	if(strcmp(key, "outLatencyMaxMs") == 0) {
+		return PyInt_FromLong(player->outLatencyMaxMs);
+	}
+
+	if(strcmp(key, "adaptiveLatency") == 0) {
+		return PyBool_FromLong(player->adaptiveLatency);
+	}
+
+	if(strcmp(key, "outLatencyStats") == 0) {
+		return player->outLatencyStats();
+	}
+
+	if(strcmp(key, "startVirtualSink") == 0) {
+		return PyCFunction_New(&md_startVirtualSink, (PyObject*) player);
+	}
+
+	if(strcmp(key, "startRenderSink") == 0) {
+		return PyCFunction_New(&md_startRenderSink, (PyObject*) player);
+	}
+
+	if(strcmp(key, "stopSink") == 0) {
+		return PyCFunction_New(&md_stopSink, (PyObject*) player);
+	}
+
+	if(strcmp(key, "sinkStats") == 0) {
+		return player->sinkStats();
+	}
+
+	if(strcmp(key, "stats") == 0) {
+		return player->statsSnapshot();
+	}
+
+	if(strcmp(key, "outputMode") == 0) {
+		return PyString_FromString(player->outBlocking ? "blocking" : "callback");
+	}
+
+	if(strcmp(key, "outBlockMs") == 0) {
+		return PyInt_FromLong(player->outBlockMs);
+	}
+
+	if(strcmp(key, "asyncEvents") == 0) {
+		return PyBool_FromLong(player->asyncEvents);
+	}
+
+	if(strcmp(key, "decodeCpuAffinity") == 0) {
+		std::vector<int> cpus;
+		Py_BEGIN_ALLOW_THREADS
+		{
+			PyScopedLock lock(player->lock);
+			cpus = player->decodeCpuAffinity;
+		}
+		Py_END_ALLOW_THREADS
+		if(cpus.empty()) {
+			Py_INCREF(Py_None);
+			return Py_None;
+		}
+		PyObject* tuple = PyTuple_New(cpus.size());
+		if(!tuple) return NULL;
+		for(size_t i = 0; i < cpus.size(); ++i)
+			PyTuple_SET_ITEM(tuple, i, PyInt_FromLong(cpus[i]));
+		return tuple;
+	}
+
+	if(strcmp(key, "peekDecodeNice") == 0) {
+		int nice;
+		Py_BEGIN_ALLOW_THREADS
+		{
+			PyScopedLock lock(player->lock);
+			nice = player->peekDecodeNice;
+		}
+		Py_END_ALLOW_THREADS
+		return PyInt_FromLong(nice);
+	}
+
+	if(strcmp(key, "fileIo") == 0) {
+		switch(player->fileIo) {
+		case PlayerObject::FileIo_Python: return PyString_FromString("python");
+		case PlayerObject::FileIo_ReadAhead: return PyString_FromString("readahead");
+		case PlayerObject::FileIo_Mmap: return PyString_FromString("mmap");
+		}
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
 	{
 		PyObject* dict = player_getdict(player);
 		if(dict) { // should always be true...
@@ -796,6 +1142,169 @@ int player_setattr(PyObject* obj, char* key, PyObject* value) {
 		return 0;
 	}
 
+	if(strcmp(key, "fastStart") == 0) {
+		player->fastStart = PyObject_IsTrue(value);
+		return 0;
+	}
+
+	if(strcmp(key, "asyncEvents") == 0) {
+		player->asyncEvents = PyObject_IsTrue(value);
+		return 0;
+	}
+
+	if(strcmp(key, "decodeCpuAffinity") == 0) {
+		// None means all CPUs.
+		std::vector<int> cpus;
+		if(value != Py_None) {
+			PyObject* seq = PySequence_Fast(value, "decodeCpuAffinity must be a sequence of ints or None");
+			if(!seq) return -1;
+			for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); ++i) {
+				long cpu = PyInt_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+				if(cpu == -1 && PyErr_Occurred()) {
+					Py_DECREF(seq);
+					return -1;
+				}
+				if(cpu < 0) {
+					Py_DECREF(seq);
+					PyErr_SetString(PyExc_ValueError, "decodeCpuAffinity: cpu must be >= 0");
+					return -1;
+				}
+				cpus.push_back((int) cpu);
+			}
+			Py_DECREF(seq);
+		}
+		Py_BEGIN_ALLOW_THREADS
+		{
+			PyScopedLock lock(player->lock);
+			player->decodeCpuAffinity = cpus;
+			player->decodeSchedulingVersion++;
+		}
+		Py_END_ALLOW_THREADS
+		return 0;
+	}
+
+	if(strcmp(key, "peekDecodeNice") == 0) {
+		long nice = PyInt_AsLong(value);
+		if(nice == -1 && PyErr_Occurred()) return -1;
+		Py_BEGIN_ALLOW_THREADS
+		{
+			PyScopedLock lock(player->lock);
+			player->peekDecodeNice = (int) nice;
+			player->decodeSchedulingVersion++;
+		}
+		Py_END_ALLOW_THREADS
+		return 0;
+	}
+
+	if(strcmp(key, "fileIo") == 0) {
+		// Used for songs which are opened after this.
+		std::string mode;
+		if(!pyStr(value, mode)) {
+			PyErr_SetString(PyExc_ValueError, "fileIo must be a string");
+			return -1;
+		}
+		if(mode == "python")
+			player->fileIo = PlayerObject::FileIo_Python;
+		else if(mode == "readahead")
+			player->fileIo = PlayerObject::FileIo_ReadAhead;
+		else if(mode == "mmap")
+			player->fileIo = PlayerObject::FileIo_Mmap;
+		else {
+			PyErr_Format(PyExc_ValueError, "fileIo must be 'python', 'readahead' or 'mmap', got '%s'", mode.c_str());
+			return -1;
+		}
+		return 0;
+	}
+
+	if(strcmp(key, "peekStreamNum") == 0) {
+		int num = 0;
+		if(!PyArg_Parse(value, "i", &num))
+			return -1;
+		if(num < 0) num = 0;
+		player->peekStreamNum = num;
+		return 0;
+	}
+
+	if(strcmp(key, "mixAheadMs") == 0) {
+		// Used when the output stream is opened the next time.
+		int ms = 0;
+		if(!PyArg_Parse(value, "i", &ms))
+			return -1;
+		if(ms < 0 || ms > 1000) {
+			PyErr_SetString(PyExc_ValueError, "mixAheadMs must be in [0, 1000]");
+			return -1;
+		}
+		player->mixAheadMs = ms;
+		return 0;
+	}
+
+	if(strcmp(key, "outLatencyMs") == 0 || strcmp(key, "outLatencyMaxMs") == 0) {
+		// Used when the output stream is opened the next time.
+		int ms = 0;
+		if(!PyArg_Parse(value, "i", &ms))
+			return -1;
+		if(ms <= 0 || ms > 5000) {
+			PyErr_Format(PyExc_ValueError, "%s must be in [1, 5000]", key);
+			return -1;
+		}
+		PyScopedGIUnlock gunlock;
+		PyScopedLock lock(player->lock);
+		if(strcmp(key, "outLatencyMs") == 0)
+			player->outLatencyMs = player->outLatencyCurMs = ms;
+		else
+			player->outLatencyMaxMs = ms;
+		return 0;
+	}
+
+	if(strcmp(key, "adaptiveLatency") == 0) {
+		player->adaptiveLatency = PyObject_IsTrue(value);
+		return 0;
+	}
+
+	if(strcmp(key, "outputMode") == 0) {
+		// Used when the output stream is opened the next time.
+		std::string mode;
+		if(!pyStr(value, mode)) {
+			PyErr_SetString(PyExc_ValueError, "outputMode must be a string");
+			return -1;
+		}
+		if(mode == "callback")
+			player->outBlocking = false;
+		else if(mode == "blocking")
+			player->outBlocking = true;
+		else {
+			PyErr_Format(PyExc_ValueError, "outputMode must be 'callback' or 'blocking', got '%s'", mode.c_str());
+			return -1;
+		}
+		return 0;
+	}
+
+	if(strcmp(key, "outBlockMs") == 0) {
+		// For the blocking outputMode. Used when the output stream is opened the next time.
+		int ms = 0;
+		if(!PyArg_Parse(value, "i", &ms))
+			return -1;
+		if(ms < 1 || ms > 1000) {
+			PyErr_SetString(PyExc_ValueError, "outBlockMs must be in [1, 1000]");
+			return -1;
+		}
+		player->outBlockMs = ms;
+		return 0;
+	}
+
+	if(strcmp(key, "historyBufferSize") == 0) {
+		Py_ssize_t size = 0;
+		if(!PyArg_Parse(value, "n", &size))
+			return -1;
+		if(size < 0) size = 0;
+		PyScopedGIUnlock gunlock;
+		PyScopedLock lock(player->lock);
+		player->historyBufferSize = size;
+		for(PlayerInStream& is : player->inStreams)
+			is.outBuffer.historyLimit = size;
+		return 0;
+	}
+
 	PyObject* s = PyString_FromString(key);
 	if(!s) return -1;
 	int ret = PyObject_GenericSetAttr(obj, s, value);
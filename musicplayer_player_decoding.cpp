@@ -13,11 +13,16 @@
 #include "Log.hpp"
 #include "PythonHelpers.h"
 #include "Py3Compat.h"
+#include "ReadAheadFile.hpp"
+#include "MmapFile.hpp"
+#include "ThreadScheduling.hpp"
 
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libswresample/swresample.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
 }
 
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(55,28,1)
@@ -25,16 +30,38 @@ extern "C" {
 #define av_frame_unref avcodec_get_frame_defaults
 #endif
 
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(55,16,0)
+#define av_packet_ref av_copy_packet
+#define av_packet_unref av_free_packet
+#endif
+
 #include <math.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <vector>
-#include <set>
+#include <map>
 
 #define PROCESS_SIZE		(BUFFER_CHUNK_SIZE * 10) // how much data to proceed in processInStream()
 #define BUFFER_FILL_SECS	10
 #define BUFFER_FILL_SIZE	(48000 * 2 * OUTSAMPLEBYTELEN * BUFFER_FILL_SECS) // 10 secs for 48kHz,stereo - around 2MB
-#define PEEKSTREAM_NUM		3
+#define PEEKSTREAM_DECODE_NUM	2 // how many of the peek streams are opened and decoded
+#define PEEKSTREAM_HEAD_SECS	2
+#define PEEKSTREAM_HEAD_SIZE	(48000 * 2 * OUTSAMPLEBYTELEN * PEEKSTREAM_HEAD_SECS) // how much we decode of those
+#define PEEKSTREAM_WARMUP_SIZE	(1024 * 256) // read ahead for the other peek songs
+#define SEEK_DECODE_AHEAD_SECS	5 // forward seeks up to this behind the buffer end just decode ahead
+#define PREROLL_MIN_SECS	0.2 // we always want at least this buffered before we start playing
+#define PREROLL_SPEED_SAFETY	2 // we assume the decoding can be this much slower than measured
+#define DECODE_SPEED_DECAY	0.9 // for the decaying sums of PlayerInStream::decodeSpeed and demuxSpeed
+#define DEMUX_PACKETS_PER_ROUND	16 // then the demux thread goes on with the next stream
+#define DECODE_THREAD_IDLE_WAIT_SECS	1.0 // backstop for the demux and peek decode threads, see wakeDecodeThreads()
+#define SEEKINDEX_MAX_DECODE_SECS	2 // decode and drop at most this after a seek via the SeekIndex
+#define SEEKINDEX_MAX_SCAN_SECS	120 // scan packets for the SeekIndex for at most this
+#define PROBECACHE_MAX_ENTRIES	10000
+#define FAST_PROBE_SIZE		(1024 * 32) // probesize when we know the format already
+#define FAST_ANALYZE_DURATION	(AV_TIME_BASE / 2)
 
 
 Log workerLog("Worker");
@@ -91,24 +118,8 @@ void SmoothClipCalc::setX(float x1, float x2) {
 	s->d = (1. / 4.) * ((((x1 + x2 - 2.) * pow(x1, 3.)) / pow(x2 - x1, 3.)) - ((4. * x2 * (x1 + x2 - 2.) * pow(x1, 2.)) / pow(x2 - x1, 3.)) - (((x1 + x2 - 2.) * pow(x1, 2.)) / pow(x2 - x1, 3.)) - ((pow(x2, 2.) * (x1 + x2 - 2.) * x1) / pow(x2 - x1, 3.)) + ((2. * x2 * (x1 + x2 - 2.) * x1) / pow(x2 - x1, 3.)) + ((6. * (x1 + x2 - 2.) * x1) / pow(x2 - x1, 3.)) + x1 - ((pow(x2, 2.) * (x1 + x2 - 2.)) / pow(x2 - x1, 3.)) + ((6. * x2 * (x1 + x2 - 2.)) / pow(x2 - x1, 3.)) + ((4. * (- (((x1 + x2 - 2.) * pow(x1, 2.)) / pow(x2 - x1, 3.)) - ((4. * x2 * (x1 + x2 - 2.) * x1) / pow(x2 - x1, 3.)) + ((6. * (x1 + x2 - 2.) * x1) / pow(x2 - x1, 3.)) - ((7. * pow(x2, 2.) * (x1 + x2 - 2.)) / pow(x2 - x1, 3.)) + ((6. * x2 * (x1 + x2 - 2.)) / pow(x2 - x1, 3.)) - 1.)) / (4. * x2 - 4.)) + 1.);
 }
 
-static int player_read_packet(PlayerInStream* is, uint8_t* buf, int buf_size) {
-	// We assume that we don't have the PlayerObject lock at this point and not the Python GIL.
-	//printf("player_read_packet %i\n", buf_size);
-
-	if(is->player == NULL) return -1;
-
-	PyObject* song = NULL;
-	bool skipPyExceptions = false;;
-	{
-		PyScopedLock lock(is->player->lock);
-		PyScopedGIL gstate;
-		song = is->song;
-		if(song == NULL) return -1;
-		Py_INCREF(song);
-		skipPyExceptions = is->player->skipPyExceptions;
-	}
-
-	PyScopedGIL gstate;
+// We expect to hold the Python GIL.
+static int song_read_packet(PyObject* song, bool skipPyExceptions, uint8_t* buf, int buf_size) {
 	Py_ssize_t ret = -1;
 	PyObject *readPacketFunc = NULL, *args = NULL, *retObj = NULL;
 
@@ -141,7 +152,6 @@ final:
 	Py_XDECREF(retObj);
 	Py_XDECREF(args);
 	Py_XDECREF(readPacketFunc);
-	Py_XDECREF(song);
 
 	if(skipPyExceptions && PyErr_Occurred())
 		PyErr_Print();
@@ -149,28 +159,14 @@ final:
 	return (int) ret;
 }
 
-static int64_t player_seek(PlayerInStream* is, int64_t offset, int whence) {
-	// We assume that we don't have the PlayerObject lock at this point and not the Python GIL.
-	//printf("player_seek %lli %i\n", offset, whence);
-
-	if(is->player == NULL) return -1;
-
-	PyObject* song = NULL;
-	bool skipPyExceptions = false;;
-	{
-		PyScopedLock lock(is->player->lock);
-		PyScopedGIL gstate;
-		song = is->song;
-		if(song == NULL) return -1;
-		Py_INCREF(song);
-		skipPyExceptions = is->player->skipPyExceptions;
-	}
-
-	PyScopedGIL gstate;
+// We expect to hold the Python GIL.
+static int64_t song_seek(PyObject* song, bool skipPyExceptions, int64_t offset, int whence) {
 	int64_t ret = -1;
 
 	PyObject *seekRawFunc = NULL, *args = NULL, *retObj = NULL;
-	if(whence == AVSEEK_SIZE) goto final; // Ignore and return -1. This is supported by FFmpeg.
+	// Ignore and return -1. This is supported by FFmpeg.
+	// Only the direct file modes (see LocalFile) know the size.
+	if(whence == AVSEEK_SIZE) goto final;
 	if(whence & AVSEEK_FORCE) whence &= ~AVSEEK_FORCE; // Can be ignored.
 	if(whence != SEEK_SET && whence != SEEK_CUR && whence != SEEK_END) {
 		printf("player_seek: invalid whence in params offset:%lli whence:%i\n", offset, whence);
@@ -193,9 +189,9 @@ static int64_t player_seek(PlayerInStream* is, int64_t offset, int whence) {
 
 	// NOTE: I don't really know what would be the best strategy in case of overflow...
 	if(PyInt_Check(retObj))
-		ret = (int) PyInt_AsLong(retObj);
+		ret = PyInt_AsLong(retObj);
 	else if(PyLong_Check(retObj))
-		ret = (int) PyLong_AsLong(retObj);
+		ret = PyLong_AsLongLong(retObj);
 	else {
 		printf("song.seekRaw didn't returned an int but a %s\n", retObj->ob_type->tp_name);
 		goto final;
@@ -205,7 +201,6 @@ final:
 	Py_XDECREF(retObj);
 	Py_XDECREF(args);
 	Py_XDECREF(seekRawFunc);
-	Py_XDECREF(song);
 
 	if(skipPyExceptions && PyErr_Occurred())
 		PyErr_Print();
@@ -213,6 +208,54 @@ final:
 	return ret;
 }
 
+static int player_read_packet(PlayerInStream* is, uint8_t* buf, int buf_size) {
+	// We assume that we don't have the PlayerObject lock at this point and not the Python GIL.
+	//printf("player_read_packet %i\n", buf_size);
+
+	if(is->player == NULL) return -1;
+
+	PyObject* song = NULL;
+	bool skipPyExceptions = false;;
+	{
+		PyScopedLock lock(is->player->lock);
+		PyScopedGIL gstate;
+		song = is->song;
+		if(song == NULL) return -1;
+		Py_INCREF(song);
+		skipPyExceptions = is->player->skipPyExceptions;
+	}
+
+	PyScopedGIL gstate;
+	int ret = song_read_packet(song, skipPyExceptions, buf, buf_size);
+	Py_DECREF(song);
+	is->player->stats.add(PlayerStats::PyReadCalls);
+	if(ret > 0) is->player->stats.add(PlayerStats::PyReadBytes, ret);
+	return ret;
+}
+
+static int64_t player_seek(PlayerInStream* is, int64_t offset, int whence) {
+	// We assume that we don't have the PlayerObject lock at this point and not the Python GIL.
+	//printf("player_seek %lli %i\n", offset, whence);
+
+	if(is->player == NULL) return -1;
+
+	PyObject* song = NULL;
+	bool skipPyExceptions = false;;
+	{
+		PyScopedLock lock(is->player->lock);
+		PyScopedGIL gstate;
+		song = is->song;
+		if(song == NULL) return -1;
+		Py_INCREF(song);
+		skipPyExceptions = is->player->skipPyExceptions;
+	}
+
+	PyScopedGIL gstate;
+	int64_t ret = song_seek(song, skipPyExceptions, offset, whence);
+	Py_DECREF(song);
+	return ret;
+}
+
 static int _player_av_read_packet(void *opaque, uint8_t *buf, int buf_size) {
 	return player_read_packet((PlayerInStream*)opaque, buf, buf_size);
 }
@@ -221,8 +264,19 @@ static int64_t _player_av_seek(void *opaque, int64_t offset, int whence) {
 	return player_seek((PlayerInStream*)opaque, offset, whence);
 }
 
+static int _file_av_read_packet(void *opaque, uint8_t *buf, int buf_size) {
+	return ((PlayerInStream*)opaque)->file->read(buf, buf_size);
+}
+
+static int64_t _file_av_seek(void *opaque, int64_t offset, int whence) {
+	return ((PlayerInStream*)opaque)->file->seek(offset, whence);
+}
+
+typedef int (*ReadPacketFunc)(void *opaque, uint8_t *buf, int buf_size);
+typedef int64_t (*SeekFunc)(void *opaque, int64_t offset, int whence);
+
 static
-AVIOContext* initIoCtx(PlayerInStream* is) {
+AVIOContext* initIoCtx(void* opaque, ReadPacketFunc readPacket, SeekFunc seek) {
 	int buffer_size = 1024 * 4;
 	unsigned char* buffer = (unsigned char*)av_malloc(buffer_size);
 
@@ -230,21 +284,21 @@ AVIOContext* initIoCtx(PlayerInStream* is) {
 										 buffer,
 										 buffer_size,
 										 0, // writeflag
-										 is, // opaque
-										 _player_av_read_packet,
+										 opaque,
+										 readPacket,
 										 NULL, // write_packet
-										 _player_av_seek
+										 seek
 										 );
 
 	return io;
 }
 
 static
-AVFormatContext* initFormatCtx(PlayerInStream* is) {
+AVFormatContext* initFormatCtx(void* opaque, ReadPacketFunc readPacket, SeekFunc seek) {
 	AVFormatContext* fmt = avformat_alloc_context();
 	if(!fmt) return NULL;
 
-	fmt->pb = initIoCtx(is);
+	fmt->pb = initIoCtx(opaque, readPacket, seek);
 	if(!fmt->pb) {
 		printf("initIoCtx failed\n");
 	}
@@ -255,6 +309,79 @@ AVFormatContext* initFormatCtx(PlayerInStream* is) {
 }
 
 
+// Remembers which input format and audio stream worked for a local file.
+// When we open the same file again (peek streams, getMetadata, replay),
+// we skip the format probing and let avformat_find_stream_info read much less.
+// The file identity is the url plus size and mtime, so a changed file
+// is probed again. Songs which are not local files are not cached.
+struct ProbeCacheEntry {
+	off_t fileSize;
+	time_t fileMTime;
+	AVInputFormat* fmt;
+	int nbStreams;
+	int audioStream;
+	enum AVCodecID codecId;
+	int64_t duration; // in stream time base, or AV_NOPTS_VALUE
+};
+
+typedef std::map<std::string, ProbeCacheEntry> ProbeCache;
+
+static PyMutex& probeCacheLock() {
+	static PyMutex lock;
+	return lock;
+}
+
+static ProbeCache& probeCache() {
+	static ProbeCache cache;
+	return cache;
+}
+
+static bool probeCacheStat(const std::string& url, ProbeCacheEntry& entry) {
+	if(url.empty()) return false;
+	struct stat st;
+	if(stat(url.c_str(), &st) != 0) return false;
+	if(!S_ISREG(st.st_mode)) return false;
+	entry.fileSize = st.st_size;
+	entry.fileMTime = st.st_mtime;
+	return true;
+}
+
+static bool probeCacheLookup(const std::string& url, const ProbeCacheEntry& fileId, ProbeCacheEntry& entry) {
+	PyScopedLock lock(probeCacheLock());
+	ProbeCache::iterator it = probeCache().find(url);
+	if(it == probeCache().end()) return false;
+	if(it->second.fileSize != fileId.fileSize || it->second.fileMTime != fileId.fileMTime) {
+		probeCache().erase(it);
+		return false;
+	}
+	entry = it->second;
+	return true;
+}
+
+static void probeCacheInsert(const std::string& url, const ProbeCacheEntry& entry) {
+	PyScopedLock lock(probeCacheLock());
+	ProbeCache& cache = probeCache();
+	if(cache.size() >= PROBECACHE_MAX_ENTRIES && cache.find(url) == cache.end())
+		cache.erase(cache.begin()); // just some entry, we don't need a real LRU here
+	cache[url] = entry;
+}
+
+static void probeCacheRemove(const std::string& url) {
+	PyScopedLock lock(probeCacheLock());
+	probeCache().erase(url);
+}
+
+static bool probeCacheMatches(const ProbeCacheEntry& entry, AVFormatContext* formatCtx, int audioStream) {
+	if((int)formatCtx->nb_streams != entry.nbStreams) return false;
+	if(audioStream != entry.audioStream) return false;
+	AVCodecContext* avctx = formatCtx->streams[audioStream]->codec;
+	if(avctx->codec_id != entry.codecId) return false;
+	// Too little probing can leave these unset.
+	if(avctx->sample_rate <= 0 || avctx->channels <= 0) return false;
+	return true;
+}
+
+
 static void player_resetStreamPackets(PlayerInStream* player) {
 	av_free_packet(&player->audio_pkt);
 	memset(&player->audio_pkt, 0, sizeof(player->audio_pkt));
@@ -262,14 +389,20 @@ static void player_resetStreamPackets(PlayerInStream* player) {
 }
 
 void PlayerInStream::resetBuffers() {
+	// We expect to have the stream lock and demuxLock.
 	this->do_flush = true;
 	this->readerHitEnd = false;
 	this->outBuffer.clear();
+	this->skipOutBytes = 0;
 	player_resetStreamPackets(this);
+	this->packets.flush();
+	this->demuxHitEnd = false;
+	if(player) player->wakeDecodeThreads();
 }
 
 void PlayerInStream::seekAbs(double pos) {
 	// We expect to have the stream lock and not the PyGIL.
+	PyScopedLock lock(demuxLock);
 
 	if(pos < 0) pos = 0;
 
@@ -281,6 +414,10 @@ void PlayerInStream::seekAbs(double pos) {
 	double incr = playerTimePos - pos;
 	playerTimePos = readerTimePos = pos;
 
+	if(useSeekIndex && seekWithIndex(pos))
+		return;
+	seekIndexTrusted = false; // until we get a pts
+
 	int64_t seek_target = int64_t(pos * AV_TIME_BASE);
 	int64_t seek_min    = (incr > 0) ? (seek_target - int64_t(incr * AV_TIME_BASE) + 2) : 0;
 	int64_t seek_max    = (incr < 0) ? (seek_target - int64_t(incr * AV_TIME_BASE) - 2) : INT64_MAX;
@@ -302,6 +439,108 @@ void PlayerInStream::seekAbs(double pos) {
 		printf("(%s) seekAbs(%f): seek failed\n", debugName.c_str(), pos);
 }
 
+void PlayerInStream::scanSeekIndex(const SeekIndex::Entry& start, double pos) {
+	// We expect to have the stream lock, demuxLock and not the PyGIL.
+	// This only reads the packets from start until pos, no decoding,
+	// and adds them to the seekIndex.
+	if(avformat_seek_file(ctx, -1, start.pos, start.pos, start.pos, AVSEEK_FLAG_BYTE) < 0)
+		return;
+	double time = start.time;
+	AVPacket pkt;
+	while(av_read_frame(ctx, &pkt) >= 0) {
+		bool finished = false;
+		if(pkt.stream_index == audio_stream) {
+			if(pkt.pts != AV_NOPTS_VALUE)
+				time = av_q2d(audio_st->time_base) * pkt.pts;
+			if(pkt.pos >= 0)
+				seekIndex.add(time, pkt.pos);
+			if(time >= pos)
+				finished = true;
+			else if(pkt.duration <= 0)
+				finished = true; // we don't know the time of the next packet
+			else
+				time += av_q2d(audio_st->time_base) * pkt.duration;
+		}
+		av_free_packet(&pkt);
+		if(finished) break;
+	}
+}
+
+bool PlayerInStream::seekWithIndex(double pos) {
+	// We expect to have the stream lock, demuxLock and not the PyGIL.
+	// resetBuffers() was already called.
+	// We seek to the byte offset of the last known packet before pos
+	// and let the reader drop the decoded data until pos.
+	SeekIndex::Entry entry;
+	if(!seekIndex.lookup(pos, entry)) return false;
+	if(pos - entry.time > SEEKINDEX_MAX_DECODE_SECS) {
+		if(pos - entry.time > SEEKINDEX_MAX_SCAN_SECS) return false;
+		scanSeekIndex(entry, pos);
+		if(!seekIndex.lookup(pos, entry)) return false;
+		if(pos - entry.time > SEEKINDEX_MAX_DECODE_SECS) return false;
+	}
+
+	if(avformat_seek_file(ctx, -1, entry.pos, entry.pos, entry.pos, AVSEEK_FLAG_BYTE) < 0) {
+		printf("(%s) seekWithIndex(%f): byte seek failed\n", debugName.c_str(), pos);
+		return false;
+	}
+	readerTimePos = entry.time;
+	seekIndexTrusted = true;
+
+	PyScopedLock lock(player->lock);
+	const size_t frameSize = player->outNumChannels * OUTSAMPLEBYTELEN;
+	skipOutBytes = size_t((pos - entry.time) * player->outSamplerate) * frameSize;
+	return true;
+}
+
+bool PlayerInStream::seekInBuffer(double pos) {
+	// We expect to have the stream lock and not the PyGIL.
+	// outBuffer holds the decoded data starting at playerTimePos.
+	// If pos is inside of it, we just drop the data before pos.
+	// If pos is a bit behind of it, we let the reader drop the data
+	// until pos while it decodes ahead, which is still cheaper than
+	// a container seek with a codec flush.
+	// If pos is before it but in the outBuffer history
+	// (see PlayerObject::historyBufferSize), we rewind.
+	// Returns false if this is not possible and seekAbs() is needed.
+
+	if(pos < 0) pos = 0;
+	if(do_flush) return false; // a real seek is pending anyway
+
+	PyScopedLock lock(player->lock);
+	if(player->outSamplerate <= 0 || player->outNumChannels <= 0) return false;
+	double offset = pos - playerTimePos;
+	const size_t frameSize = player->outNumChannels * OUTSAMPLEBYTELEN;
+
+	if(offset < 0) {
+		// Backward seek. This works if we still have it in the history,
+		// or if it is within the data we would drop anyway.
+		size_t rewindSize = size_t(-offset * player->outSamplerate) * frameSize;
+		if(rewindSize > skipOutBytes + outBuffer.historySize()) return false;
+		if(rewindSize <= skipOutBytes)
+			skipOutBytes -= rewindSize;
+		else {
+			outBuffer.rewind(rewindSize - skipOutBytes);
+			skipOutBytes = 0;
+		}
+		playerTimePos = playerTimePos - player->timeDelay(rewindSize / OUTSAMPLEBYTELEN);
+		return true;
+	}
+
+	size_t skipSize = size_t(offset * player->outSamplerate) * frameSize;
+	if(skipSize > outBuffer.size()) {
+		if(readerHitEnd) return false;
+		size_t aheadSize = skipSize - outBuffer.size();
+		if(aheadSize > size_t(SEEK_DECODE_AHEAD_SECS * player->outSamplerate) * frameSize)
+			return false;
+		skipOutBytes += aheadSize;
+	}
+	outBuffer.skip(std::min(skipSize, (size_t)outBuffer.size()), false);
+
+	playerTimePos = playerTimePos + player->timeDelay(skipSize / OUTSAMPLEBYTELEN);
+	return true;
+}
+
 void PlayerObject::resetBuffers() {
 	PyScopedUnlock unlock(this->lock);
 
@@ -312,11 +551,11 @@ void PlayerObject::resetBuffers() {
 }
 
 void PlayerObject::seekSong(double pos, bool relativePos) {
-	outOfSync = true;
 	PlayerObject* pl = this;
 	InStreams::ItemPtr isptr = pl->getInStream();
 	if(!isptr.get()) return;
 	PlayerInStream* is = &isptr->value;
+	pl->mixerResync = true;
 
 	PyScopedUnlock unlock(pl->lock);
 	{
@@ -334,8 +573,16 @@ void PlayerObject::seekSong(double pos, bool relativePos) {
 		}
 
 		// No fading.
-		else
+		else if(is->seekInBuffer(pos)) {
+			// If we must decode ahead, wait until we have data again.
+			PyScopedLock lock(pl->lock);
+			if(is->outBuffer.empty())
+				pl->outOfSync = true;
+		}
+		else {
 			is->seekAbs(pos);
+			pl->outOfSync = true;
+		}
 	}
 
 	isptr.reset(); // must be reset in unlocked scope
@@ -365,6 +612,60 @@ float PlayerObject::curSongGainFactor() const {
 	return 1;
 }
 
+PyObject* PlayerObject::statsSnapshot() {
+	PyObject* dict = PyDict_New();
+	if(!dict) return NULL;
+	stats.addToDict(dict);
+
+	PyObject* output = PyDict_New();
+	if(output) {
+		PyDict_SetItemString_retain(output, "underflows", PyLong_FromUnsignedLongLong(outUnderflows));
+		PyDict_SetItemString_retain(output, "slowCallbacks", PyLong_FromUnsignedLongLong(outSlowCallbacks));
+		PyDict_SetItemString_retain(output, "mixerUnderruns", PyLong_FromUnsignedLongLong(mixerUnderruns));
+		PyDict_SetItemString_retain(output, "timeToFirstSample", PyFloat_FromDouble(timeToFirstSample));
+		PyDict_SetItemString_retain(dict, "output", output);
+	}
+
+	// Without the stream locks, thus this doesn't wait for a decode.
+	// The url is only set in open().
+	PyObject* streams = PyList_New(0);
+	if(streams) {
+		for(PlayerInStream& is : inStreams) {
+			PyObject* d = PyDict_New();
+			if(!d) break;
+			PyDict_SetItemString_retain(d, "url", PyString_FromString(is.url.c_str()));
+			PyDict_SetItemString_retain(d, "bufferBytes", PyLong_FromSize_t(is.outBuffer.size()));
+			PyDict_SetItemString_retain(d, "bufferSecs", PyFloat_FromDouble(timeDelay(is.outBuffer.size() / OUTSAMPLEBYTELEN)));
+			PyDict_SetItemString_retain(d, "queuePackets", PyLong_FromSize_t(is.packets.count));
+			PyDict_SetItemString_retain(d, "queueBytes", PyLong_FromSize_t(is.packets.bytes));
+			PyDict_SetItemString_retain(d, "decodeSecs", PyFloat_FromDouble(is.decodeSecs));
+			PyDict_SetItemString_retain(d, "resampleSecs", PyFloat_FromDouble(is.resampleSecs));
+			PyDict_SetItemString_retain(d, "decodeSpeed", PyFloat_FromDouble(is.decodeSpeed));
+			PyDict_SetItemString_retain(d, "demuxSpeed", PyFloat_FromDouble(is.demuxSpeed));
+			PyList_Append(streams, d);
+			Py_DECREF(d);
+		}
+		PyDict_SetItemString_retain(dict, "streams", streams);
+	}
+	return dict;
+}
+
+PyObject* PlayerObject::curSongPacketStats() const {
+	InStreams::ItemPtr isPtr = getInStream();
+	PyObject* stats = PyDict_New();
+	if(!stats || !isPtr.get()) return stats;
+	PlayerInStream& is = isPtr->value;
+	PyDict_SetItemString_retain(stats, "queuePackets", PyLong_FromSize_t(is.packets.count));
+	PyDict_SetItemString_retain(stats, "queueBytes", PyLong_FromSize_t(is.packets.bytes));
+	PyDict_SetItemString_retain(stats, "queueSecs", PyFloat_FromDouble(is.packets.duration));
+	PyDict_SetItemString_retain(stats, "demuxedPackets", PyLong_FromUnsignedLongLong(is.demuxedPackets));
+	PyDict_SetItemString_retain(stats, "demuxedBytes", PyLong_FromUnsignedLongLong(is.demuxedBytes));
+	double secs = is.demuxedSecs;
+	// In bits per second, of the audio stream.
+	PyDict_SetItemString_retain(stats, "bitrate", PyFloat_FromDouble(secs > 0 ? is.demuxedBytes * 8 / secs : 0));
+	return stats;
+}
+
 
 
 
@@ -439,40 +740,45 @@ static int stream_component_open(PlayerInStream *is, AVFormatContext* ic, int st
 }
 
 
-static void player_setSongMetadata(PlayerInStream* player) {
-	Py_XDECREF(player->metadata);
-	player->metadata = NULL;
-
-	if(!player->ctx) return;
-	if(!player->ctx->metadata) return;
-	AVDictionary* m = player->ctx->metadata;
+// Returns a new dict with the tags of the container, or NULL if there are none.
+// We expect to hold the Python GIL.
+static PyObject* makeSongMetadata(AVFormatContext* ctx, double timeLen) {
+	if(!ctx) return NULL;
+	if(!ctx->metadata) return NULL;
+	AVDictionary* m = ctx->metadata;
 
-	player->metadata = PyDict_New();
-	assert(player->metadata);
+	PyObject* metadata = PyDict_New();
+	assert(metadata);
 
 	AVDictionaryEntry* tag = NULL;
 	while((tag = av_dict_get(m, "", tag, AV_DICT_IGNORE_SUFFIX))) {
 		if(strcmp("language", tag->key) == 0)
 			continue;
 
-		PyDict_SetItemString_retain(player->metadata, tag->key, PyString_FromString(tag->value));
+		PyDict_SetItemString_retain(metadata, tag->key, PyString_FromString(tag->value));
 	}
 
-	if(player->timeLen > 0) {
-		PyDict_SetItemString_retain(player->metadata, "duration", PyFloat_FromDouble(player->timeLen));
+	if(timeLen > 0) {
+		PyDict_SetItemString_retain(metadata, "duration", PyFloat_FromDouble(timeLen));
 	}
-	else if(PyDict_GetItemString(player->metadata, "duration")) {
+	else if(PyDict_GetItemString(metadata, "duration")) {
 		// we have an earlier duration metadata which is a string now.
 		// convert it to float.
-		PyObject* floatObj = PyFloat_FromString(PyDict_GetItemString(player->metadata, "duration"));
+		PyObject* floatObj = PyFloat_FromString(PyDict_GetItemString(metadata, "duration"));
 		if(!floatObj) {
 			PyErr_Clear();
-			PyDict_DelItemString(player->metadata, "duration");
+			PyDict_DelItemString(metadata, "duration");
 		}
 		else {
-			PyDict_SetItemString_retain(player->metadata, "duration", floatObj);
+			PyDict_SetItemString_retain(metadata, "duration", floatObj);
 		}
 	}
+	return metadata;
+}
+
+static void player_setSongMetadata(PlayerInStream* player) {
+	Py_XDECREF(player->metadata);
+	player->metadata = makeSongMetadata(player->ctx, player->timeLen);
 }
 
 static void closeInputStream(AVFormatContext* formatCtx) {
@@ -493,6 +799,8 @@ static void closeInputStream(AVFormatContext* formatCtx) {
 
 PlayerInStream::~PlayerInStream() {
 	PlayerInStream* is = this;
+	if(is->useSeekIndex && is->seekIndex.changed)
+		is->seekIndex.save();
 	player_resetStreamPackets(is);
 	if(is->ctx) {
 		closeInputStream(is->ctx);
@@ -521,43 +829,28 @@ PlayerInStream::~PlayerInStream() {
 }
 
 
-bool PlayerInStream::open(PlayerObject* pl, PyObject* song) {
-	// We assume to not have the PlayerObject lock and neither the GIL.
-	assert(song != NULL);
-
-	if(this->player == NULL)
-		this->player = pl;
-	else {
-		assert(this->player == pl);
-	}
-
-	{
-		PyScopedLock lock(pl->lock);
-		while(pl->openStreamLock) {
-			PyScopedUnlock(pl->lock);
-			usleep(100);
-		}
-		pl->openStreamLock = true;
-	}
-
-	{
-		PyScopedGIL glock;
-		Py_XDECREF(this->song); // if there is any old song
-		Py_INCREF(song);
-	}
-	this->song = song;
+static std::string songDebugName(const std::string& url) {
+	// the url is just for debugging, the song object provides its own IO
+	size_t f = url.rfind('/');
+	if(f != std::string::npos)
+		return url.substr(f + 1);
+	return url;
+}
 
-	PlayerInStream* player = this;
+// Opens the container and finds the audio stream. We try the format from the
+// probe cache first, then the one by file extension, autodetection and mp3.
+// openStream (optional) is called with the found audio stream. If it fails,
+// we try the next format. Returns NULL if nothing worked.
+// We assume to not have the GIL.
+static AVFormatContext* openContainer(
+	const std::string& url, const std::string& debugName,
+	void* opaque, ReadPacketFunc readPacket, SeekFunc seek,
+	int& audioStream,
+	const std::function<bool(AVFormatContext*, int)>& openStream)
+{
 	int ret = 0;
-
 	AVFormatContext* formatCtx = NULL;
 
-	debugName = objAttrStr(song, "url"); // the url is just for debugging, the song object provides its own IO
-	{
-		size_t f = debugName.rfind('/');
-		if(f != std::string::npos)
-			debugName = debugName.substr(f + 1);
-	}
 	const char* fileExt = NULL;
 	{
 		size_t f = debugName.rfind('.');
@@ -565,29 +858,45 @@ bool PlayerInStream::open(PlayerObject* pl, PyObject* song) {
 			fileExt = &debugName[f+1];
 	}
 
+	ProbeCacheEntry probeEntry;
+	memset(&probeEntry, 0, sizeof(probeEntry));
+	bool probeCacheable = probeCacheStat(url, probeEntry);
+	ProbeCacheEntry probeCached;
+	bool haveProbeCached = probeCacheable && probeCacheLookup(url, probeEntry, probeCached);
+
 	AVInputFormat* fmts[] = {
+		haveProbeCached ? probeCached.fmt : NULL, // fast path, without probing
 		fileExt ? av_find_input_format(fileExt) : NULL,
 		NULL,
 		av_find_input_format("mp3")
 	};
 	for(size_t i = 0; i < sizeof(fmts)/sizeof(fmts[0]); ++i) {
-		if(i == 1 && fmts[0] == NULL) continue; // we already tried NULL
+		if(i == 0 && !haveProbeCached) continue;
+		if(i == 2 && fmts[1] == NULL) continue; // we already tried NULL
 		AVInputFormat* fmt = fmts[i];
+		bool fastOpen = (i == 0);
 
 		if(formatCtx)
 			closeInputStream(formatCtx);
-		player_seek(this, 0, SEEK_SET);
+		formatCtx = NULL;
+		seek(opaque, 0, SEEK_SET);
 
-		formatCtx = initFormatCtx(this);
+		formatCtx = initFormatCtx(opaque, readPacket, seek);
 		if(!formatCtx) {
 			printf("(%s) initFormatCtx failed\n", debugName.c_str());
-			goto final;
+			return NULL;
 		}
 
-		ret = av_probe_input_buffer(formatCtx->pb, &fmt, debugName.c_str(), NULL, 0, formatCtx->probesize);
-		if(ret < 0) {
-			printf("(%s) av_probe_input_buffer failed (%s)\n", debugName.c_str(), fmt ? fmt->name : "<NULL>");
-			continue;
+		if(fastOpen) {
+			av_opt_set_int(formatCtx, "probesize", FAST_PROBE_SIZE, 0);
+			av_opt_set_int(formatCtx, "analyzeduration", FAST_ANALYZE_DURATION, 0);
+		}
+		else {
+			ret = av_probe_input_buffer(formatCtx->pb, &fmt, debugName.c_str(), NULL, 0, formatCtx->probesize);
+			if(ret < 0) {
+				printf("(%s) av_probe_input_buffer failed (%s)\n", debugName.c_str(), fmt ? fmt->name : "<NULL>");
+				continue;
+			}
 		}
 
 		ret = avformat_open_input(&formatCtx, debugName.c_str(), fmt, NULL);
@@ -623,34 +932,124 @@ bool PlayerInStream::open(PlayerObject* pl, PyObject* song) {
 			av_log_set_level(oldloglevel);
 			continue;
 		}
-		player->audio_stream = ret;
+		audioStream = ret;
 
-		ret = stream_component_open(player, formatCtx, player->audio_stream);
-		if(ret < 0) {
+		if(fastOpen && !probeCacheMatches(probeCached, formatCtx, audioStream)) {
+			// Reduced probing was not enough or the file is different. Probe fully.
+			probeCacheRemove(url);
+			continue;
+		}
+
+		if(openStream && !openStream(formatCtx, audioStream)) {
 			printf("(%s) cannot open audio stream (%s)\n", debugName.c_str(), fmt->name);
 			continue;
 		}
 
-		if(i > 0)
+		if(i > 1)
 			printf("(%s) fallback open succeeded (%s)\n", debugName.c_str(), fmt->name);
-		goto success;
+
+		AVStream* st = formatCtx->streams[audioStream];
+		if(haveProbeCached && st->duration == AV_NOPTS_VALUE)
+			// Less probing might not give us the duration. Use the one from the full probing.
+			st->duration = probeCached.duration;
+		if(probeCacheable) {
+			probeEntry.fmt = formatCtx->iformat;
+			probeEntry.nbStreams = formatCtx->nb_streams;
+			probeEntry.audioStream = audioStream;
+			probeEntry.codecId = st->codec->codec_id;
+			probeEntry.duration = st->duration;
+			probeCacheInsert(url, probeEntry);
+		}
+		return formatCtx;
 	}
-	printf("(%s) opening failed\n", debugName.c_str());
-	goto final;
 
-success:
-	player->ctx = formatCtx;
-	formatCtx = NULL;
+	printf("(%s) opening failed\n", debugName.c_str());
+	if(formatCtx)
+		closeInputStream(formatCtx);
+	if(probeCacheable)
+		probeCacheRemove(url);
+	return NULL;
+}
 
+static double streamTimeLen(AVStream* st) {
 	// Get the song len: There is formatCtx.duration in AV_TIME_BASE
 	// and there is stream.duration in stream time base.
-	assert(player->audio_st);
-	this->timeLen = av_q2d(player->audio_st->time_base) * player->audio_st->duration;
+	double timeLen = av_q2d(st->time_base) * st->duration;
 	//if(player->timeLen < 0) { // happens in some cases, e.g. some flac files
 	//	player->timeLen = av_q2d(AV_TIME_BASE_Q) * formatCtx->duration; // doesnt make it better though...
 	//}
-	if(this->timeLen < 0)
-		this->timeLen = -1;
+	if(timeLen < 0)
+		timeLen = -1;
+	return timeLen;
+}
+
+bool PlayerInStream::open(PlayerObject* pl, PyObject* song) {
+	// We assume to not have the PlayerObject lock and neither the GIL.
+	assert(song != NULL);
+
+	if(this->player == NULL)
+		this->player = pl;
+	else {
+		assert(this->player == pl);
+	}
+
+	{
+		PyScopedLock lock(pl->lock);
+		LockProfilerSpinWait spinWait("openStreamLock");
+		while(pl->openStreamLock) {
+			spinWait.spin();
+			PyScopedUnlock unlock(pl->lock);
+			usleep(100);
+		}
+		spinWait.finish();
+		pl->openStreamLock = true;
+	}
+
+	{
+		PyScopedGIL glock;
+		Py_XDECREF(this->song); // if there is any old song
+		Py_INCREF(song);
+	}
+	this->song = song;
+
+	url = songUrl(song);
+	debugName = url.empty() ? objAttrStr(song, "url") : songDebugName(url);
+	outBuffer.historyLimit = pl->historyBufferSize;
+
+	{
+		ReadPacketFunc readPacket = _player_av_read_packet;
+		SeekFunc seek = _player_av_seek;
+		if(pl->fileIo == PlayerObject::FileIo_ReadAhead)
+			file.reset(new ReadAheadFile());
+		else if(pl->fileIo == PlayerObject::FileIo_Mmap)
+			file.reset(new MmapFile());
+		if(file) {
+			// Bypasses song.readPacket. Not a local file if this fails.
+			if(file->open(url)) {
+				readPacket = _file_av_read_packet;
+				seek = _file_av_seek;
+			}
+			else
+				file.reset();
+		}
+
+		this->ctx = openContainer(
+			url, debugName, this, readPacket, seek,
+			this->audio_stream,
+			[this](AVFormatContext* formatCtx, int streamIndex) {
+				return stream_component_open(this, formatCtx, streamIndex) >= 0;
+			});
+	}
+	if(!this->ctx) goto final;
+
+	assert(this->audio_st);
+	this->timeLen = streamTimeLen(this->audio_st);
+
+	// FFmpeg has a good index already e.g. for MP4. Otherwise, we use our own.
+	this->useSeekIndex = !(this->ctx->iformat->flags & AVFMT_NO_BYTE_SEEK) && this->audio_st->nb_index_entries == 0;
+	this->seekIndexTrusted = true; // we start at the beginning
+	if(this->useSeekIndex)
+		this->seekIndex.load(url);
 
 	{
 		PyScopedGIL glock;
@@ -697,14 +1096,223 @@ success:
 	}
 
 final:
-	if(formatCtx) closeInputStream(formatCtx);
-
 	pl->openStreamLock = false;
 
-	if(this->ctx) return true;
+	if(this->ctx) {
+		packets.wakeup = &pl->demuxThread.wakeup;
+		demuxReady = true;
+		pl->wakeDecodeThreads();
+		return true;
+	}
 	return false;
 }
 
+// IO for readSongMetadata(): either the song object or the file directly.
+struct SongMetadataSource {
+	PyObject* song;
+	bool skipPyExceptions;
+	int fd;
+};
+
+static int _metadata_av_read_packet(void *opaque, uint8_t *buf, int buf_size) {
+	SongMetadataSource* src = (SongMetadataSource*)opaque;
+	if(src->song) {
+		PyScopedGIL gstate;
+		return song_read_packet(src->song, src->skipPyExceptions, buf, buf_size);
+	}
+	while(true) {
+		ssize_t ret = read(src->fd, buf, buf_size);
+		if(ret < 0 && errno == EINTR) continue;
+		return (ret < 0) ? -1 : (int) ret;
+	}
+}
+
+static int64_t _metadata_av_seek(void *opaque, int64_t offset, int whence) {
+	SongMetadataSource* src = (SongMetadataSource*)opaque;
+	if(src->song) {
+		PyScopedGIL gstate;
+		return song_seek(src->song, src->skipPyExceptions, offset, whence);
+	}
+	if(whence & AVSEEK_FORCE) whence &= ~AVSEEK_FORCE; // Can be ignored.
+	if(whence == AVSEEK_SIZE) {
+		struct stat st;
+		if(fstat(src->fd, &st) != 0) return -1;
+		return st.st_size;
+	}
+	return lseek(src->fd, offset, whence);
+}
+
+static void setMetadataDefault(PyObject* metadata, const char* key, PyObject* value) {
+	// Tags from the file take precedence.
+	if(value && !PyDict_GetItemString(metadata, key))
+		PyDict_SetItemString(metadata, key, value);
+	Py_XDECREF(value);
+}
+
+struct SongCoverArt {
+	AVPacket pkt; // the original picture, if not scaled
+	uint8_t* rgb; // RGB24 thumbnail, av_malloc'ed
+	size_t rgbSize;
+	int width, height;
+	const char* codec;
+};
+
+// Decodes the attached picture and scales it down to fit into
+// maxSize x maxSize (keeping the aspect ratio) as RGB24.
+static bool scaleCoverArt(AVStream* st, int maxSize, SongCoverArt& art, const std::string& debugName) {
+	AVCodecContext* avctx = st->codec;
+	AVCodec* codec = avcodec_find_decoder(avctx->codec_id);
+	if(!codec || avcodec_open2(avctx, codec, NULL) < 0) {
+		printf("(%s) cannot open cover art decoder (%s)\n", debugName.c_str(), avcodec_get_name(avctx->codec_id));
+		return false;
+	}
+
+	bool res = false;
+	struct SwsContext* sws = NULL;
+	AVFrame* frame = av_frame_alloc();
+	int gotFrame = 0;
+	if(!frame) goto final;
+	if(avcodec_decode_video2(avctx, frame, &gotFrame, &st->attached_pic) < 0 || !gotFrame) {
+		printf("(%s) cannot decode cover art (%s)\n", debugName.c_str(), codec->name);
+		goto final;
+	}
+	if(avctx->width <= 0 || avctx->height <= 0) goto final;
+
+	art.width = avctx->width;
+	art.height = avctx->height;
+	if(art.width > maxSize || art.height > maxSize) {
+		if(art.width >= art.height) {
+			art.height = std::max(1, art.height * maxSize / art.width);
+			art.width = maxSize;
+		}
+		else {
+			art.width = std::max(1, art.width * maxSize / art.height);
+			art.height = maxSize;
+		}
+	}
+
+	sws = sws_getContext(
+		avctx->width, avctx->height, (enum AVPixelFormat) frame->format,
+		art.width, art.height, AV_PIX_FMT_RGB24,
+		SWS_AREA, NULL, NULL, NULL);
+	if(!sws) goto final;
+
+	art.rgbSize = (size_t) art.width * art.height * 3;
+	art.rgb = (uint8_t*) av_malloc(art.rgbSize);
+	if(!art.rgb) goto final;
+	{
+		uint8_t* dst[1] = {art.rgb};
+		int dstStride[1] = {art.width * 3};
+		sws_scale(sws, frame->data, frame->linesize, 0, avctx->height, dst, dstStride);
+	}
+	res = true;
+
+final:
+	if(sws) sws_freeContext(sws);
+	if(frame) {
+		av_frame_unref(frame);
+		av_free(frame);
+	}
+	return res;
+}
+
+PyObject* readSongMetadata(PyObject* song, const std::string& url, bool skipPyExceptions, bool withCoverArt, int thumbnailSize) {
+	// We assume to not have the GIL.
+	SongMetadataSource src;
+	src.song = song;
+	src.skipPyExceptions = skipPyExceptions;
+	src.fd = -1;
+	if(!song) {
+		src.fd = ::open(url.c_str(), O_RDONLY);
+		if(src.fd < 0) {
+			printf("(%s) cannot open file: %s\n", url.c_str(), strerror(errno));
+			return NULL;
+		}
+	}
+
+	std::string debugName = songDebugName(url);
+	int audioStream = -1;
+	AVFormatContext* formatCtx = openContainer(
+		url, debugName, &src, _metadata_av_read_packet, _metadata_av_seek,
+		audioStream, NULL);
+	if(src.fd >= 0 && !formatCtx) {
+		close(src.fd);
+		src.fd = -1;
+	}
+	if(!formatCtx) return NULL;
+
+	AVStream* st = formatCtx->streams[audioStream];
+	double timeLen = streamTimeLen(st);
+
+	// Attached pictures are already read by avformat_open_input,
+	// so we get them from the same open as the tags.
+	std::vector<SongCoverArt> coverArts;
+	for(unsigned int i = 0; withCoverArt && i < formatCtx->nb_streams; ++i) {
+		AVStream* picSt = formatCtx->streams[i];
+		if(!(picSt->disposition & AV_DISPOSITION_ATTACHED_PIC)) continue;
+		if(picSt->attached_pic.size <= 0) continue;
+		SongCoverArt art;
+		memset(&art, 0, sizeof(art));
+		art.codec = avcodec_get_name(picSt->codec->codec_id);
+		if(thumbnailSize > 0) {
+			if(!scaleCoverArt(picSt, thumbnailSize, art, debugName)) continue;
+		}
+		else {
+			if(av_packet_ref(&art.pkt, &picSt->attached_pic) < 0) continue;
+			art.width = picSt->codec->width;
+			art.height = picSt->codec->height;
+		}
+		coverArts.push_back(art);
+	}
+
+	PyObject* metadata = NULL;
+	{
+		PyScopedGIL gstate;
+		metadata = makeSongMetadata(formatCtx, timeLen);
+		if(!metadata) {
+			metadata = PyDict_New();
+			if(timeLen > 0)
+				PyDict_SetItemString_retain(metadata, "duration", PyFloat_FromDouble(timeLen));
+		}
+		setMetadataDefault(metadata, "format", PyString_FromString(formatCtx->iformat->name));
+		setMetadataDefault(metadata, "codec", PyString_FromString(avcodec_get_name(st->codec->codec_id)));
+		int bitRate = st->codec->bit_rate ? st->codec->bit_rate : formatCtx->bit_rate;
+		if(bitRate > 0)
+			setMetadataDefault(metadata, "bit_rate", PyInt_FromLong(bitRate));
+		if(st->codec->sample_rate > 0)
+			setMetadataDefault(metadata, "sample_rate", PyInt_FromLong(st->codec->sample_rate));
+		if(st->codec->channels > 0)
+			setMetadataDefault(metadata, "channels", PyInt_FromLong(st->codec->channels));
+
+		if(withCoverArt) {
+			// List of dicts. "data" is a buffer object with the encoded picture,
+			// or the RGB24 pixels if a thumbnail was requested.
+			PyObject* coverArtList = PyList_New(0);
+			for(SongCoverArt& art : coverArts) {
+				PyObject* artDict = PyDict_New();
+				if(art.rgb) {
+					PyDict_SetItemString_retain(artDict, "data", newAVBufferFromData(art.rgb, art.rgbSize));
+					PyDict_SetItemString_retain(artDict, "format", PyString_FromString("rgb24"));
+				}
+				else {
+					PyDict_SetItemString_retain(artDict, "data", newAVBufferFromPacket(&art.pkt));
+					PyDict_SetItemString_retain(artDict, "format", PyString_FromString(art.codec));
+				}
+				PyDict_SetItemString_retain(artDict, "width", PyInt_FromLong(art.width));
+				PyDict_SetItemString_retain(artDict, "height", PyInt_FromLong(art.height));
+				PyList_Append(coverArtList, artDict);
+				Py_DECREF(artDict);
+			}
+			PyDict_SetItemString_retain(metadata, "cover_art", coverArtList);
+		}
+	}
+
+	closeInputStream(formatCtx);
+	if(src.fd >= 0)
+		close(src.fd);
+	return metadata;
+}
+
 bool PlayerObject::openInStream() {
 	assert(this->curSong != NULL);
 
@@ -736,6 +1344,7 @@ bool PlayerObject::openInStream() {
 	}
 
 	inStreams.push_front(is);
+	wakeDecodeThreads();
 	return true;
 }
 
@@ -818,7 +1427,9 @@ static long audio_decode_frame(PlayerObject* player, PlayerInStream *is, long le
 			if (flush_complete)
 				break;
 			int got_frame = 0;
+			PlayerStatsTimer decodeTimer(player->stats, PlayerStats::DecodeFrameDuration, PlayerStats::DecodeUs);
 			int len1 = avcodec_decode_audio4(dec, is->frame, &got_frame, pkt_temp);
+			is->decodeSecs = is->decodeSecs + decodeTimer.finish();
 			if (len1 < 0) {
 				pkt_temp->size = 0;
 				// warning only at pos 0. this seems too common and i don't like a spammy log...
@@ -850,6 +1461,7 @@ static long audio_decode_frame(PlayerObject* player, PlayerInStream *is, long le
 					flush_complete = 1;
 				continue;
 			}
+			player->stats.add(PlayerStats::DecodedFrames);
 			data_size = av_samples_get_buffer_size(NULL, dec->channels,
 												   is->frame->nb_samples,
 												   dec->sample_fmt, 1);
@@ -904,7 +1516,11 @@ static long audio_decode_frame(PlayerObject* player, PlayerInStream *is, long le
 						break;
 					}
 				}
+				double resampleStartTime = monotonicTime();
 				len2 = swr_convert(is->swr_ctx, out, out_count, in, is->frame->nb_samples);
+				double resampleSecs = monotonicTime() - resampleStartTime;
+				player->stats.add(PlayerStats::ResampleUs, uint64_t(resampleSecs * 1000000));
+				is->resampleSecs = is->resampleSecs + resampleSecs;
 				if (len2 < 0) {
 					fprintf(stderr, "swr_convert() failed\n");
 					break;
@@ -922,7 +1538,9 @@ static long audio_decode_frame(PlayerObject* player, PlayerInStream *is, long le
 
 			{
 				PyScopedLock lock(player->lock);
-				is->outBuffer.push(is->audio_buf, resampled_data_size);
+				size_t skipSize = std::min(is->skipOutBytes, (size_t)resampled_data_size);
+				is->skipOutBytes -= skipSize;
+				is->outBuffer.push(is->audio_buf + skipSize, resampled_data_size - skipSize);
 			}
 
 			/* if no pts, then compute it */
@@ -945,23 +1563,13 @@ static long audio_decode_frame(PlayerObject* player, PlayerInStream *is, long le
 		av_free_packet(pkt);
 		memset(pkt_temp, 0, sizeof(*pkt_temp));
 
-		while(1) {
-			int ret = av_read_frame(is->ctx, pkt);
-			if (ret < 0) {
-				if(is->readerTimePos == 0)
-					printf("(%s) av_read_frame error at pos 0\n", is->debugName.c_str());
-				//if (ic->pb && ic->pb->error)
-				//	printf("av_read_frame error\n");
-				//if (ret == AVERROR_EOF || url_feof(is->ctx->pb))
-				// no matter what, set hitEnd because we want to proceed with the next song and don't know what to do here otherwise.
-				is->readerHitEnd = true;
-				return count;
-			}
-
-			if(pkt->stream_index == is->audio_stream)
-				break;
-
-			av_free_packet(pkt);
+		if(is->nextPacket(pkt) < 0) {
+			if(is->readerTimePos == 0)
+				printf("(%s) av_read_frame error at pos 0\n", is->debugName.c_str());
+			// no matter what, set hitEnd because we want to proceed with the next song and don't know what to do here otherwise.
+			is->readerHitEnd = true;
+			player->wakeDecodeThreads(); // the next stream is not a peek stream anymore
+			return count;
 		}
 
 		*pkt_temp = *pkt;
@@ -970,21 +1578,122 @@ static long audio_decode_frame(PlayerObject* player, PlayerInStream *is, long le
 		if (pkt->pts != AV_NOPTS_VALUE) {
 			PyScopedLock lock(player->lock);
 			is->readerTimePos = av_q2d(is->audio_st->time_base)*pkt->pts;
-			if(is->outBuffer.empty())
+			if(is->outBuffer.empty() && is->skipOutBytes == 0)
 				is->playerTimePos = is->readerTimePos;
 		}
+
+		if(is->useSeekIndex && pkt->pos >= 0) {
+			if(pkt->pts != AV_NOPTS_VALUE)
+				is->seekIndexTrusted = true;
+			if(is->seekIndexTrusted)
+				is->seekIndex.add(is->readerTimePos, pkt->pos);
+		}
 	}
 }
 
-static bool _buffersFullEnough(PlayerInStream* is) {
+int PlayerInStream::demuxPacket(AVPacket* pkt) {
+	// We expect to have demuxLock and not the PyGIL.
+	// Returns <0 at the end or on error.
+	if(demuxHitEnd) return -1;
+	double startTime = monotonicTime();
+	while(true) {
+		int ret = av_read_frame(ctx, pkt);
+		if(ret < 0) {
+			//if (ic->pb && ic->pb->error)
+			//	printf("av_read_frame error\n");
+			//if (ret == AVERROR_EOF || url_feof(is->ctx->pb))
+			demuxHitEnd = true;
+			return ret;
+		}
+		if(pkt->stream_index == audio_stream)
+			break;
+		av_free_packet(pkt);
+	}
+	demuxedPackets++;
+	demuxedBytes += pkt->size;
+	player->stats.add(PlayerStats::DemuxedPackets);
+	player->stats.add(PlayerStats::DemuxedBytes, pkt->size);
+	if(pkt->duration > 0) {
+		double duration = av_q2d(audio_st->time_base) * pkt->duration;
+		demuxedSecs = demuxedSecs + duration;
+		demuxAudioTime = demuxAudioTime * DECODE_SPEED_DECAY + duration;
+		demuxWallTime = demuxWallTime * DECODE_SPEED_DECAY + (monotonicTime() - startTime);
+		if(demuxWallTime > 0)
+			demuxSpeed = demuxAudioTime / demuxWallTime;
+	}
+	return 0;
+}
+
+int PlayerInStream::nextPacket(AVPacket* pkt) {
+	// We expect to have the stream lock and not the PyGIL.
+	if(packets.pop(pkt)) return 0;
+	// The demux thread is behind or not running. Read it ourselves.
+	PyScopedLock lock(demuxLock);
+	if(packets.pop(pkt)) return 0;
+	return demuxPacket(pkt);
+}
+
+bool PlayerInStream::demuxAhead() {
+	// Called by the demux thread. We expect to not have any lock and not the PyGIL.
+	// Returns true if we queued a packet.
+	if(!demuxReady || demuxHitEnd || packets.full()) return false;
+	PyScopedLock lock(demuxLock);
+	if(demuxHitEnd || packets.full()) return false;
+	AVPacket pkt;
+	if(demuxPacket(&pkt) < 0) return false;
+	// The packet might point into the demuxer buffers, which the next read overwrites.
+	if(av_dup_packet(&pkt) < 0) {
+		av_free_packet(&pkt);
+		return false;
+	}
+	packets.push(&pkt, pkt.duration > 0 ? av_q2d(audio_st->time_base) * pkt.duration : 0);
+	return true;
+}
+
+static bool _buffersFullEnough(PlayerInStream* is, size_t fillSize) {
 	if(is->readerHitEnd) return true;
-	if(is->outBuffer.size() >= BUFFER_FILL_SIZE) return true;
+	if(is->outBuffer.size() >= fillSize) return true;
 	return false;
 }
 
 static bool _processInStream(PlayerObject* player, PlayerInStream* is) {
 	is->outBuffer.cleanup();
-	return audio_decode_frame(player, is, PROCESS_SIZE) >= 0;
+	double startTime = monotonicTime();
+	int count = audio_decode_frame(player, is, PROCESS_SIZE);
+	if(count > 0) {
+		// Decaying sums, so that we adapt e.g. to a changing network speed.
+		is->decodeAudioTime = is->decodeAudioTime * DECODE_SPEED_DECAY + player->timeDelay(count / OUTSAMPLEBYTELEN);
+		is->decodeWallTime = is->decodeWallTime * DECODE_SPEED_DECAY + (monotonicTime() - startTime);
+		if(is->decodeWallTime > 0)
+			is->decodeSpeed = is->decodeAudioTime / is->decodeWallTime;
+	}
+	return count >= 0;
+}
+
+// How much data we want to have buffered before we start playing (again), in bytes.
+// The faster we decode compared to the playback, the less we need.
+// If we are slower, we need enough so that we don't run out until the end
+// of the song (or as much as the buffer can take).
+static size_t _prerollSize(PlayerObject* player, PlayerInStream* is) {
+	// decodeSpeed doesn't cover the reading while the packets queue is filled.
+	// The demux thread can't keep it filled if the reading is the slower part,
+	// so take that into account until everything is read.
+	double speed = is->decodeSpeed;
+	if(!is->demuxHitEnd && is->demuxSpeed > 0)
+		speed = std::min(speed, (double) is->demuxSpeed);
+	speed /= PREROLL_SPEED_SAFETY;
+	double secs = BUFFER_FILL_SECS / 2.0; // if we don't know anything yet
+	if(speed >= 1)
+		secs = PREROLL_MIN_SECS;
+	else if(speed > 0) {
+		double remaining = BUFFER_FILL_SECS;
+		if(is->timeLen > 0)
+			remaining = std::min(remaining, is->timeLen - is->playerTimePos);
+		secs = std::max(remaining * (1 - speed), PREROLL_MIN_SECS);
+	}
+	// We must be able to reach it.
+	secs = std::min(secs, BUFFER_FILL_SECS * 0.9);
+	return size_t(secs * player->outSamplerate) * player->outNumChannels * OUTSAMPLEBYTELEN;
 }
 
 bool PlayerObject::processInStream() {
@@ -1013,7 +1722,14 @@ PlayerObject::InStreams::ItemPtr PlayerObject::getInStream() const {
 	return inStreams.front();
 }
 
-static bool pushPeekInStream(PlayerObject::InStreams::ItemPtr& startAfter, PyObject* song, bool& found) {
+// Songs are the same if they are the same object or have the same url
+// (if they have one at all, see songUrl()). This does not need the GIL.
+static bool isSameSong(PyObject* song1, const std::string& url1, PyObject* song2, const std::string& url2) {
+	if(song1 == song2) return true;
+	return !url1.empty() && url1 == url2;
+}
+
+static bool pushPeekInStream(PlayerObject::InStreams::ItemPtr& startAfter, PyObject* song, const std::string& url, bool& found) {
 	found = false;
 	PlayerObject::InStreams::ItemPtr foundIs = NULL;
 
@@ -1024,19 +1740,10 @@ static bool pushPeekInStream(PlayerObject::InStreams::ItemPtr& startAfter, PyObj
 			assert(is);
 			assert(is->value.song != NULL);
 
-			{
-				PyScopedGIL gstate;
-				if(PyObject_RichCompareBool(song, is->value.song, Py_EQ) == 1) {
-					foundIs = is;
-					found = true;
-				}
-
-				// pass through any Python errors
-				if(PyErr_Occurred())
-					PyErr_Print();
-
-				if(found)
-					break;
+			if(isSameSong(song, url, is->value.song, is->value.url)) {
+				foundIs = is;
+				found = true;
+				break;
 			}
 		}
 	}
@@ -1080,10 +1787,31 @@ static bool pushPeekInStream(PlayerObject::InStreams::ItemPtr& startAfter, PyObj
 
 struct PeekItem {
 	PyObject* song;
+	std::string url;
 	bool valid;
 	PeekItem(PyObject* _song = NULL) : song(_song), valid(true) {}
 };
 
+// The songs from player.setPeekSongs(). Unlike queryPeekItems(), this does not
+// call back into the player.peekQueue, but it reads song.url via getattr.
+static std::vector<PeekItem> copyPeekSongs(PlayerObject* player) {
+	// We expect to hold the player lock.
+	std::vector<PeekItem> peekItems;
+	PyScopedGIL gstate;
+	PyObject* songs = player->peekSongs;
+	if(!songs) return peekItems;
+	Py_ssize_t num = std::min(PyTuple_GET_SIZE(songs), (Py_ssize_t) player->peekStreamNum);
+	peekItems.reserve(num);
+	for(Py_ssize_t i = 0; i < num; ++i) {
+		PeekItem item(PyTuple_GET_ITEM(songs, i));
+		Py_INCREF(item.song);
+		peekItems.push_back(item);
+	}
+	for(PeekItem& it : peekItems)
+		it.url = songUrl(it.song);
+	return peekItems;
+}
+
 static std::vector<PeekItem> queryPeekItems(PlayerObject* player) {
 	std::vector<PeekItem> peekItems;
 
@@ -1095,7 +1823,7 @@ static std::vector<PeekItem> queryPeekItems(PlayerObject* player) {
 
 	args = PyTuple_New(1);
 	if(!args) goto final;
-	PyTuple_SetItem(args, 0, PyLong_FromLong(PEEKSTREAM_NUM));
+	PyTuple_SetItem(args, 0, PyLong_FromLong(player->peekStreamNum));
 	{
 		PyObject* peekQueue = player->peekQueue;
 		Py_INCREF(peekQueue);
@@ -1112,12 +1840,13 @@ static std::vector<PeekItem> queryPeekItems(PlayerObject* player) {
 
 	{
 		PyScopedGIUnlock gunlock; // let others use Python
-		peekItems.reserve(PEEKSTREAM_NUM);
+		peekItems.reserve(player->peekStreamNum);
 	}
 
 	while((song = PyIter_Next(peekListIter)) != NULL) {
 		PeekItem item;
 		item.song = song;
+		item.url = songUrl(song);
 		peekItems.push_back(item);
 	}
 
@@ -1135,17 +1864,45 @@ final:
 
 
 
+// The peek songs after the first PEEKSTREAM_DECODE_NUM only get this:
+// We let the OS read ahead the start of the file, and warmupProc() probes
+// the container, so that the ProbeCache has it. We don't keep anything else
+// for them. Only for local files, because only those are in the ProbeCache.
+// Returns true if the song should be probed.
+static bool warmupPeekSong(const std::string& url) {
+	// We expect to not have the player lock and not the GIL.
+	ProbeCacheEntry fileId, entry;
+	if(!probeCacheStat(url, fileId)) return false;
+	if(probeCacheLookup(url, fileId, entry)) return false; // already done
+
+#ifdef POSIX_FADV_WILLNEED
+	int fd = open(url.c_str(), O_RDONLY);
+	if(fd >= 0) {
+		posix_fadvise(fd, 0, PEEKSTREAM_WARMUP_SIZE, POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+#endif
+	return true;
+}
+
 void PlayerObject::openPeekInStreams() {
 	PlayerObject* player = this;
-	if(player->peekQueue == NULL) return;
+	if(player->peekQueue == NULL && player->peekSongs == NULL) return;
 
+	LockProfilerSpinWait spinWait("pyQueueLock/openStreamLock");
 	while(pyQueueLock || openStreamLock) {
+		spinWait.spin();
 		PyScopedUnlock unlock(this->lock);
 		usleep(100);
 	}
+	spinWait.finish();
 	pyQueueLock = true;
 
-	std::vector<PeekItem> peekItems = queryPeekItems(player);
+	// If the songs are pushed via setPeekSongs(), we don't call peekQueue.
+	bool explicitPeekSongs = player->peekSongs != NULL;
+	player->peekSongsReconciledVersion = player->peekSongsVersion;
+	std::vector<PeekItem> peekItems =
+		explicitPeekSongs ? copyPeekSongs(player) : queryPeekItems(player);
 	struct CleanupPeekItems {
 		std::vector<PeekItem>& peekItems;
 		CleanupPeekItems(std::vector<PeekItem>& v) : peekItems(v) {}
@@ -1176,31 +1933,41 @@ void PlayerObject::openPeekInStreams() {
 	}
 
 	for(PeekItem& it : peekItems) {
-		if(it.song == player->curSong) {
-			printf("Warning: peek queue contained current song (%s)\n", objStr(player->curSong).c_str());
+		// Only the same object. Another Song object with the same url is
+		// e.g. the next song in a repeat-one queue and should get its stream.
+		if(it.song == startAfter->value.song) {
+			// setPeekSongs() might have been called with the list starting at the current song.
+			if(!explicitPeekSongs)
+				printf("Warning: peek queue contained current song (%s)\n", it.url.c_str());
 			it.valid = false;
 		}
 	}
 
-	{
-		std::set<PyObject*> songs;
-		for(PeekItem& it : peekItems) {
-			if(!it.valid) continue;
-			if(songs.find(it.song) == songs.end())
-				songs.insert(it.song);
-			else {
-				printf("Warning: peek queue contains same song twice (%s)\n", objStr(it.song).c_str());
+	for(size_t i = 0; i < peekItems.size(); ++i) {
+		PeekItem& it = peekItems[i];
+		if(!it.valid) continue;
+		for(size_t j = 0; j < i; ++j) {
+			if(peekItems[j].valid && it.song == peekItems[j].song) {
+				printf("Warning: peek queue contains same song twice (%s)\n", it.url.c_str());
 				it.valid = false;
+				break;
 			}
 		}
 	}
 
 	bool modi = false;
+	int decodeNum = 0;
+	std::vector<std::string> warmupUrls;
 	for(PeekItem& it : peekItems) {
 		if(!it.valid) continue;
+		if(decodeNum >= PEEKSTREAM_DECODE_NUM) {
+			warmupUrls.push_back(it.url);
+			continue;
+		}
+		++decodeNum;
 
 		bool found;
-		modi |= pushPeekInStream(startAfter, it.song, found);
+		modi |= pushPeekInStream(startAfter, it.song, it.url, found);
 
 		if(!found) {
 			PlayerObject::InStreams::ItemPtr s;
@@ -1222,7 +1989,7 @@ void PlayerObject::openPeekInStreams() {
 
 	// If there is a modified peek queue, old entries might still be in there.
 	// Remove them now.
-	while(inStreams.size() > PEEKSTREAM_NUM + 1) {
+	while(inStreams.size() > PEEKSTREAM_DECODE_NUM + 1) {
 		if(!inStreams.pop_back())
 			assert(false);
 	}
@@ -1232,7 +1999,7 @@ void PlayerObject::openPeekInStreams() {
 		int c = 1;
 		for(PlayerInStream& is : inStreams) {
 			mainLog << "\n " << c << ": " << objStr(is.song);
-			if(c > PEEKSTREAM_NUM + 10) {
+			if(c > PEEKSTREAM_DECODE_NUM + 10) {
 				mainLog << "\n too many!";
 				break;
 			}
@@ -1244,6 +2011,33 @@ void PlayerObject::openPeekInStreams() {
 	}
 
 	pyQueueLock = false;
+	if(modi) wakeDecodeThreads();
+
+	std::vector<std::string> probeUrls;
+	if(!warmupUrls.empty()) {
+		PyScopedUnlock unlock(player->lock);
+		for(const std::string& url : warmupUrls)
+			if(warmupPeekSong(url))
+				probeUrls.push_back(url);
+	}
+	bool needProbe = !probeUrls.empty();
+	{
+		// The older ones are not peek songs anymore, so drop them.
+		PyScopedLock lock(warmupLock);
+		pendingWarmupUrls.swap(probeUrls);
+	}
+	if(needProbe) {
+		warmupThread.start(); // if not running yet, start
+		warmupThread.wakeup.notify();
+	}
+}
+
+void PlayerObject::openPeekInStreamsOrDefer() {
+	// We expect to hold the player lock.
+	if(fastStart)
+		peekInStreamsPending = true; // see loopFrame()
+	else
+		openPeekInStreams();
 }
 
 bool PlayerObject::tryOvertakePeekInStream() {
@@ -1251,7 +2045,7 @@ bool PlayerObject::tryOvertakePeekInStream() {
 
 	PlayerObject::InStreams::ItemPtr startAfter = inStreams.mainLink();
 	bool found;
-	pushPeekInStream(startAfter, curSong, found);
+	pushPeekInStream(startAfter, curSong, songUrl(curSong), found);
 
 	if(found) {
 		mainLog << "tryOvertakePeekInStream: overtake" << endl;
@@ -1280,6 +2074,7 @@ static bool loopFrame(PlayerObject* player) {
 		PyScopedUnlock unlock(player->lock);
 		is.reset();
 		frontPtr.reset();
+		player->wakeDecodeThreads();
 	};
 
 	auto switchNextSong = [&](bool skipped = false) {
@@ -1295,31 +2090,14 @@ static bool loopFrame(PlayerObject* player) {
 
 	auto pushPyEv_onSongFinished = [&](PlayerInStream* inStream) {
 		if(player->dict) {
-			PyScopedGIL gstate;
-
-			Py_INCREF(player->dict);
-			PyObject* onSongFinished = PyDict_GetItemString(player->dict, "onSongFinished");
-			if(onSongFinished && onSongFinished != Py_None) {
-				Py_INCREF(onSongFinished);
-
-				PyObject* kwargs = PyDict_New();
-				assert(kwargs);
-				if(inStream->song)
-					PyDict_SetItemString(kwargs, "song", inStream->song);
-
-				PyDict_SetItemString_retain(kwargs, "finalTimePos", PyFloat_FromDouble(inStream->playerTimePos));
-
-				PyObject* retObj = PyEval_CallObjectWithKeywords(onSongFinished, NULL, kwargs);
-				Py_XDECREF(retObj);
-
-				// errors are not fatal from the callback, so handle it now and go on
-				if(PyErr_Occurred())
-					PyErr_Print();
-
-				Py_DECREF(kwargs);
-				Py_DECREF(onSongFinished);
+			PlayerEvent ev(PlayerEvent::SongFinished);
+			{
+				PyScopedGIL gstate;
+				ev.song = inStream->song;
+				Py_XINCREF(ev.song);
 			}
-			Py_DECREF(player->dict);
+			ev.finalTimePos = inStream->playerTimePos;
+			player->pushEvent(ev);
 		}
 	};
 
@@ -1346,7 +2124,7 @@ static bool loopFrame(PlayerObject* player) {
 			<< " is not the same as the first stream " << objStr(inStream->song) << endl;
 			bool ret = player->openInStream();
 			if(ret && player->nextSongOnEof)
-				player->openPeekInStreams();
+				player->openPeekInStreamsOrDefer();
 		}
 
 		else if(inStream && inStream->playerHitEnd) {
@@ -1367,10 +2145,19 @@ static bool loopFrame(PlayerObject* player) {
 			// Currently, that's only seeking.
 			if(inStream->seekPos >= 0) {
 				workerLog << "faded-out: seek stream to " << inStream->seekPos << endl;
-				PyScopedUnlock unlock(player->lock);
-				PyScopedLock lock(inStream->lock);
-				inStream->seekAbs(inStream->seekPos);
-				inStream->seekPos = -1;
+				bool inBuffer = false;
+				{
+					PyScopedUnlock unlock(player->lock);
+					PyScopedLock lock(inStream->lock);
+					inBuffer = inStream->seekInBuffer(inStream->seekPos);
+					if(!inBuffer)
+						inStream->seekAbs(inStream->seekPos);
+					inStream->seekPos = -1;
+				}
+				// readOutStream() marked us out-of-sync while faded-out.
+				// No need to wait for a refill if the data is already there.
+				if(inBuffer && !inStream->outBuffer.empty())
+					player->outOfSync = false;
 			}
 
 			if(inStream->skipMe) {
@@ -1391,17 +2178,44 @@ static bool loopFrame(PlayerObject* player) {
 
 	}
 
+	// The current song gets the full buffer (also the next one if the current
+	// is already fully decoded). The peekDecodeThread decodes the heads of the others.
+	size_t fillSize = BUFFER_FILL_SIZE;
 	for(PlayerInStream& is : player->inStreams) {
+		if(fillSize != BUFFER_FILL_SIZE) break;
 		PyScopedLock lock(is.lock);
-		if(!_buffersFullEnough(&is)) {
+		is.outBuffer.cleanup(); // also keeps the history within its limit
+		if(!_buffersFullEnough(&is, fillSize)) {
 			_processInStream(player, &is);
 			didSomething = true;
 		}
+		if(!is.readerHitEnd)
+			fillSize = PEEKSTREAM_HEAD_SIZE;
 	}
 
 	{
 		PyScopedLock lock(player->lock);
-		if(player->isOutStreamOpen() && !player->playing && player->fader.finished()) {
+
+		// setPeekSongs() was called. If the list didn't change, we don't need the GIL at all.
+		if(player->peekSongs && player->nextSongOnEof && player->peekSongsVersion != player->peekSongsReconciledVersion) {
+			workerLog << "peek songs changed" << endl;
+			player->openPeekInStreamsOrDefer();
+			didSomething = true;
+		}
+
+		// With fastStart, open the peek streams once the current song could start playing.
+		if(player->peekInStreamsPending) {
+			PlayerObject::InStreams::ItemPtr inStreamPtr = player->inStreams.front();
+			PlayerInStream* inStream = inStreamPtr ? &inStreamPtr->value : NULL;
+			if(!inStream || inStream->readerHitEnd || inStream->outBuffer.size() > _prerollSize(player, inStream)) {
+				workerLog << "open deferred peek streams" << endl;
+				player->peekInStreamsPending = false;
+				player->openPeekInStreams();
+				didSomething = true;
+			}
+		}
+
+		if(!player->outStreamOpening && player->isOutStreamOpen() && !player->playing && player->fader.finished()) {
 			workerLog << "close output stream" << endl;
 			player->closeOutStream(true);
 		}
@@ -1437,14 +2251,46 @@ static void ThreadHangDetector_unregisterCurThread() {
 }
 
 
+PlayerObject::DecodeThreadScheduling::DecodeThreadScheduling()
+: appliedVersion(-1), baseNice(getCurThreadNice()) {}
+
+void PlayerObject::applyDecodeThreadScheduling(const char* thread, bool usePeekDecodeNice, DecodeThreadScheduling& state) {
+	// We expect to not hold the player lock.
+	int version = decodeSchedulingVersion;
+	if(version == state.appliedVersion) return;
+	bool first = state.appliedVersion < 0;
+	state.appliedVersion = version;
+
+	std::vector<int> cpus;
+	int niceDelta = 0;
+	{
+		PyScopedLock lock(this->lock);
+		cpus = decodeCpuAffinity;
+		if(usePeekDecodeNice) niceDelta = peekDecodeNice;
+	}
+	std::string info;
+	// Don't touch the affinity if it was never configured.
+	if(first && cpus.empty())
+		info = "all cpus";
+	else
+		info = setCurThreadAffinity(cpus);
+	if(niceDelta != 0 || !first)
+		info += ", " + setCurThreadNice(state.baseNice + niceDelta);
+	setThreadSchedulingInfo(thread, info);
+}
+
 void PlayerObject::workerProc(std::atomic<bool>& stopSignal) {
 	setCurThreadName("musicplayer.so worker");
 	ThreadHangDetector_registerCurThread("musicplayer.so worker", 5);
+	PlayerStats::setCurThread(PlayerStats::T_Worker);
+	DecodeThreadScheduling scheduling;
 
 	while(true) {
 		if(stopSignal) break;
+		applyDecodeThreadScheduling("worker", false, scheduling);
 
 		bool didSomething = loopFrame(this);
+		adaptOutLatency();
 		ThreadHangDetector_lifeSignalCurThread();
 		if(!didSomething)
 			usleep(1000);
@@ -1453,8 +2299,92 @@ void PlayerObject::workerProc(std::atomic<bool>& stopSignal) {
 	ThreadHangDetector_unregisterCurThread();
 }
 
+void PlayerObject::demuxProc(std::atomic<bool>& stopSignal) {
+	setCurThreadName("musicplayer.so demux");
+	PlayerStats::setCurThread(PlayerStats::T_Demux);
+	DecodeThreadScheduling scheduling;
+
+	while(!stopSignal) {
+		applyDecodeThreadScheduling("demux", false, scheduling);
+		bool didSomething = false;
+		// The front stream first, i.e. the current song.
+		for(PlayerInStream& is : inStreams) {
+			if(stopSignal) break;
+			for(int i = 0; i < DEMUX_PACKETS_PER_ROUND; ++i) {
+				if(!is.demuxAhead()) break;
+				didSomething = true;
+			}
+		}
+		if(!didSomething)
+			demuxThread.wakeup.wait(DECODE_THREAD_IDLE_WAIT_SECS);
+	}
+}
+
+void PlayerObject::peekDecodeProc(std::atomic<bool>& stopSignal) {
+	setCurThreadName("musicplayer.so peek decoder");
+	PlayerStats::setCurThread(PlayerStats::T_PeekDecoder);
+	DecodeThreadScheduling scheduling;
+
+	while(!stopSignal) {
+		applyDecodeThreadScheduling("peek decoder", true, scheduling);
+		bool didSomething = false;
+		// Like in loopFrame(): Everything up to the first stream which is
+		// not fully decoded yet is for the worker.
+		bool isPeek = false;
+		for(PlayerInStream& is : inStreams) {
+			if(stopSignal) break;
+			PyScopedLock lock(is.lock);
+			if(!isPeek) {
+				if(!is.readerHitEnd) isPeek = true;
+				continue;
+			}
+			is.outBuffer.cleanup();
+			if(!_buffersFullEnough(&is, PEEKSTREAM_HEAD_SIZE)) {
+				_processInStream(this, &is);
+				didSomething = true;
+			}
+		}
+		if(!didSomething)
+			peekDecodeThread.wakeup.wait(DECODE_THREAD_IDLE_WAIT_SECS);
+	}
+}
+
+void PlayerObject::warmupProc(std::atomic<bool>& stopSignal) {
+	setCurThreadName("musicplayer.so warmup");
+	DecodeThreadScheduling scheduling;
+
+	while(!stopSignal) {
+		applyDecodeThreadScheduling("warmup", true, scheduling);
+		std::string url;
+		{
+			PyScopedLock lock(warmupLock);
+			if(!pendingWarmupUrls.empty()) {
+				url = pendingWarmupUrls.front();
+				pendingWarmupUrls.erase(pendingWarmupUrls.begin());
+			}
+		}
+		if(url.empty()) {
+			warmupThread.wakeup.wait(DECODE_THREAD_IDLE_WAIT_SECS);
+			continue;
+		}
+		// This reads the file directly and fills the ProbeCache.
+		PyObject* metadata = readSongMetadata(NULL, url, true);
+		if(metadata) {
+			PyScopedGIL gstate;
+			Py_DECREF(metadata);
+		}
+	}
+}
+
+void PlayerObject::wakeDecodeThreads() {
+	demuxThread.wakeup.notify();
+	peekDecodeThread.wakeup.notify();
+}
+
 void PlayerObject::startWorkerThread() {
 	workerThread.start();
+	demuxThread.start();
+	peekDecodeThread.start();
 }
 
 
@@ -1463,6 +2393,9 @@ bool PlayerObject::readOutStream(OUTSAMPLE_t* samples, size_t sampleNum, size_t*
 	PlayerObject* player = this;
 	OUTSAMPLE_t* origSamples = samples;
 	size_t origSampleNum = sampleNum;
+	PlayerStatsTimer statsTimer(stats, PlayerStats::ReadOutDuration);
+	stats.add(PlayerStats::ReadOutCalls);
+	stats.add(PlayerStats::ReadOutSamples, sampleNum);
 
 	Fader::Scope faderScope(fader);
 
@@ -1477,6 +2410,7 @@ bool PlayerObject::readOutStream(OUTSAMPLE_t* samples, size_t sampleNum, size_t*
 
 			// Fill the buffer with silence.
 			memset((uint8_t*)samples, 0, sampleNum*OUTSAMPLEBYTELEN);
+			stats.add(PlayerStats::SilenceSamples, sampleNum);
 			return false;
 		}
 	}
@@ -1487,12 +2421,21 @@ bool PlayerObject::readOutStream(OUTSAMPLE_t* samples, size_t sampleNum, size_t*
 			bool outOfSync = player->outOfSync.exchange(false);
 
 			if(outOfSync) {
+				double now = monotonicTime();
+				if(player->syncStartTime == 0) {
+					player->syncStartTime = now;
+					stats.add(PlayerStats::OutOfSyncEvents);
+				}
+
 				// check if there is enough data
 				size_t availableSize = 0;
+				size_t prerollSize = 0;
 				bool isEnough = false;
 				for(PlayerInStream& is : player->inStreams) {
+					if(prerollSize == 0)
+						prerollSize = _prerollSize(player, &is);
 					availableSize += is.outBuffer.size();
-					if(availableSize > BUFFER_FILL_SIZE / 2) { // half the buffer size (e.g. ~5secs)
+					if(availableSize > prerollSize) {
 						isEnough = true;
 						break;
 					}
@@ -1502,9 +2445,13 @@ bool PlayerObject::readOutStream(OUTSAMPLE_t* samples, size_t sampleNum, size_t*
 				if(!isEnough) {
 					// silence
 					memset((uint8_t*)samples, 0, sampleNum*OUTSAMPLEBYTELEN);
+					stats.add(PlayerStats::SilenceSamples, sampleNum);
 					player->outOfSync = true;
 					return false;
 				}
+
+				player->timeToFirstSample = now - player->syncStartTime;
+				player->syncStartTime = 0;
 			}
 		}
 
@@ -1552,8 +2499,11 @@ bool PlayerObject::readOutStream(OUTSAMPLE_t* samples, size_t sampleNum, size_t*
 	}
 
 	if(sampleNum > 0 && sampleNumOut == NULL) {
-		if(player->playing)
+		if(player->playing) {
 			printf("readOutStream: we have %zu too less samples available (requested %zu)\n", sampleNum, origSampleNum);
+			stats.add(PlayerStats::Underruns);
+		}
+		stats.add(PlayerStats::SilenceSamples, sampleNum);
 
 		// Fade out the current buffer.
 		// Note that this is somewhat hacky, as the number of filled samples vary.
@@ -1599,6 +2549,18 @@ pySetFfmpegLogLevel(PyObject* self, PyObject* args) {
 	return Py_None;
 }
 
+PyObject *
+pySetSeekIndexCacheDir(PyObject* self, PyObject* args) {
+	char* dir = NULL;
+	if(!PyArg_ParseTuple(args, "s:setSeekIndexCacheDir", &dir))
+		return NULL;
+
+	setSeekIndexCacheDir(dir);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
 PyObject *
 pyEnableDebugLog(PyObject* self, PyObject* args) {
 	PyObject* value = NULL;
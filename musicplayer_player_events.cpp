@@ -0,0 +1,161 @@
+// musicplayer_player_events.cpp
+// part of MusicPlayer, https://github.com/albertz/music-player
+// Copyright (c) 2012, Albert Zeyer, www.az2000.de
+// All rights reserved.
+// This code is under the 2-clause BSD license, see License.txt in the root directory of this project.
+
+// The Python callbacks onSongChange, onSongFinished and onPlayingStateChange.
+// By default, they are called directly where the event happens.
+// With player.asyncEvents, the events are pushed into a lock-free queue
+// and the event thread calls the handlers. Thus the worker never waits for
+// a slow handler (e.g. some UI update).
+
+#include "musicplayer.h"
+#include "PyUtils.h"
+#include "PythonHelpers.h"
+#include "Py3Compat.h"
+
+#include <vector>
+
+
+#define PLAYER_EVENT_IDLE_WAIT_SECS	1.0 // backstop, pushEvent() wakes up the event thread
+
+
+// We expect to hold the GIL.
+static void releaseEvent(PlayerEvent& ev) {
+	Py_CLEAR(ev.oldSong);
+	Py_CLEAR(ev.song);
+}
+
+// We expect to hold the GIL.
+static void callEventHandler(PlayerObject* player, const PlayerEvent& ev) {
+	if(!player->dict) return;
+
+	const char* name = NULL;
+	switch(ev.type) {
+	case PlayerEvent::SongChange: name = "onSongChange"; break;
+	case PlayerEvent::SongFinished: name = "onSongFinished"; break;
+	case PlayerEvent::PlayingStateChange: name = "onPlayingStateChange"; break;
+	}
+	assert(name);
+
+	PyObject* handler = PyDict_GetItemString(player->dict, name);
+	if(!handler || handler == Py_None) return;
+	Py_INCREF(handler);
+
+	PyObject* kwargs = PyDict_New();
+	assert(kwargs);
+	switch(ev.type) {
+	case PlayerEvent::SongChange:
+		PyDict_SetItemString(kwargs, "oldSong", ev.oldSong ? ev.oldSong : Py_None);
+		PyDict_SetItemString(kwargs, "newSong", ev.song ? ev.song : Py_None);
+		PyDict_SetItemString_retain(kwargs, "skipped", PyBool_FromLong(ev.skipped));
+		PyDict_SetItemString_retain(kwargs, "errorOnOpening", PyBool_FromLong(ev.errorOnOpening));
+		break;
+	case PlayerEvent::SongFinished:
+		if(ev.song)
+			PyDict_SetItemString(kwargs, "song", ev.song);
+		PyDict_SetItemString_retain(kwargs, "finalTimePos", PyFloat_FromDouble(ev.finalTimePos));
+		break;
+	case PlayerEvent::PlayingStateChange:
+		PyDict_SetItemString_retain(kwargs, "oldState", PyBool_FromLong(ev.oldState));
+		PyDict_SetItemString_retain(kwargs, "newState", PyBool_FromLong(ev.newState));
+		break;
+	}
+
+	PyObject* retObj = PyEval_CallObjectWithKeywords(handler, NULL, kwargs);
+	Py_XDECREF(retObj);
+
+	// errors are not fatal from the callback, so handle it now and go on
+	if(PyErr_Occurred())
+		PyErr_Print();
+
+	Py_DECREF(kwargs);
+	Py_DECREF(handler);
+}
+
+// Merges redundant events which were queued while the handlers were busy.
+// We expect to hold the GIL.
+static void coalesceEvents(std::vector<PlayerEvent>& events) {
+	std::vector<PlayerEvent> res;
+	res.reserve(events.size());
+	for(PlayerEvent& ev : events) {
+		PlayerEvent* last = res.empty() ? NULL : &res.back();
+		// Every finished song is reported, e.g. for play counts.
+		if(!last || last->type != ev.type || ev.type == PlayerEvent::SongFinished) {
+			res.push_back(ev);
+			continue;
+		}
+		if(ev.type == PlayerEvent::SongChange) {
+			// E.g. skipped over several songs. Report a single change
+			// from the first old song to the last new song.
+			Py_XDECREF(last->song);
+			last->song = ev.song;
+			ev.song = NULL;
+			last->skipped = last->skipped || ev.skipped;
+			last->errorOnOpening = ev.errorOnOpening;
+			releaseEvent(ev);
+		}
+		else if(ev.type == PlayerEvent::PlayingStateChange) {
+			last->newState = ev.newState;
+			// Toggled back and forth, nothing to report.
+			if(last->oldState == last->newState)
+				res.pop_back();
+		}
+	}
+	events.swap(res);
+}
+
+void PlayerObject::pushEvent(PlayerEvent ev) {
+	if(!asyncEvents) {
+		PyScopedGIL gstate;
+		callEventHandler(this, ev);
+		releaseEvent(ev);
+		return;
+	}
+
+	LinkedList<PlayerEvent>::ItemPtr item(new LinkedList<PlayerEvent>::Item());
+	item->value = ev;
+	{
+		PyScopedLock lock(eventsPushLock);
+		events.push_back(item);
+	}
+	eventThread.start(); // if not running yet, start
+	eventThread.wakeup.notify();
+}
+
+bool PlayerObject::dispatchEvents() {
+	// We are the single consumer, thus this doesn't need any lock.
+	std::vector<PlayerEvent> pending;
+	while(true) {
+		LinkedList<PlayerEvent>::ItemPtr item = events.pop_front();
+		if(!item) break;
+		pending.push_back(item->value);
+	}
+	if(pending.empty()) return false;
+
+	PyScopedGIL gstate;
+	coalesceEvents(pending);
+	for(PlayerEvent& ev : pending) {
+		callEventHandler(this, ev);
+		releaseEvent(ev);
+	}
+	return true;
+}
+
+void PlayerObject::clearEvents() {
+	while(true) {
+		LinkedList<PlayerEvent>::ItemPtr item = events.pop_front();
+		if(!item) break;
+		releaseEvent(item->value);
+	}
+}
+
+void PlayerObject::eventThreadProc(std::atomic<bool>& stopSignal) {
+	setCurThreadName("musicplayer.so events");
+
+	while(!stopSignal) {
+		if(!dispatchEvents())
+			eventThread.wakeup.wait(PLAYER_EVENT_IDLE_WAIT_SECS);
+	}
+}
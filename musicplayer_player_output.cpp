@@ -8,11 +8,15 @@
 #include "PyUtils.h"
 #include "PythonHelpers.h"
 #include "Py3Compat.h"
+#include "ThreadScheduling.hpp"
+#include "RingBuffer.hpp"
 
 #include <portaudio.h>
+#include <dlfcn.h>
 #include <functional>
 #include <atomic>
 #include <vector>
+#include <algorithm>
 
 #ifdef __APPLE__
 // PortAudio specific Mac stuff
@@ -38,7 +42,7 @@
 #include <mach/mach_error.h>
 #include <mach/mach_time.h>
 #endif
-static void setRealtime(double dutyCicleMs);
+static void setRealtime(double dutyCicleMs, const char* thread);
 
 /*
 The implementation with the PortAudio callback was there first.
@@ -48,8 +52,20 @@ maybe the blocking PortAudio implementation can avoid them better.
 For the callback, we need to minimize the locks - or better, avoid
 them fully. I'm not sure it is good to depend on thread context
 switches in case it is locked. This however needs some heavy redesign.
+Both are selectable at runtime via player.outputMode, see PlayerObject::outBlocking.
 */
-#define USE_PORTAUDIO_CALLBACK 1
+
+// See PlayerObject::mixAheadMs.
+#define MIXER_BLOCK_MS	2 // how much the mixer thread renders at once
+
+// See PlayerObject::adaptOutLatency().
+#define LATENCY_CHECK_SECS	1.0
+#define LATENCY_SLOW_CALLBACK	0.75 // of the buffer duration, counts as slow callback
+#define LATENCY_MAX_SLOW_CALLBACKS	5 // per check, more is treated like an underflow
+#define LATENCY_RAISE_FACTOR	1.5
+#define LATENCY_LOWER_AFTER_SECS	60.0 // without any underflow
+#define LATENCY_LOWER_FACTOR	0.8
+#define LATENCY_MAX_DECISIONS	32 // we keep for outLatencyStats
 
 
 static std::atomic<int> PaStreamInstanceCounter(0);
@@ -86,15 +102,62 @@ struct PlayerObject::OutStream {
 	std::atomic<bool> setThreadName;
 	std::string soundDevice;
 	PaDeviceIndex soundDeviceIdx;
+	// With player->mixAheadMs, the mixer thread calls readOutStream() and
+	// the audio thread just copies from the ring.
+	PyThread mixerThread;
+	RingBuffer<OUTSAMPLE_t> mixerRing;
+	std::atomic<bool> useMixer;
+	// The blocking PortAudio interface, i.e. Pa_WriteStream() in audioThread,
+	// instead of paStreamCallback(). Set by open().
+	bool blocking;
+	PyThread audioThread;
 
-	OutStream(PlayerObject* p) : player(p), stream(NULL), needRealtimeReset(false), setThreadName(true), soundDeviceIdx(-1) {
+	OutStream(PlayerObject* p) : player(p), stream(NULL), needRealtimeReset(false), setThreadName(true), soundDeviceIdx(-1),
+	useMixer(false), blocking(false) {
 		mlock(this, sizeof(*this));
+		mixerThread.func = [this](std::atomic<bool>& stopSignal) { mixerThreadProc(stopSignal); };
+		audioThread.func = [this](std::atomic<bool>& stopSignal) { audioThreadProc(stopSignal); };
 	}
 	~OutStream() {
 		close(false);
 	}
 
-#if USE_PORTAUDIO_CALLBACK
+	// Called from the audio thread.
+	void readOut(OUTSAMPLE_t* samples, size_t sampleNum) {
+		if(!useMixer) {
+			player->readOutStream(samples, sampleNum, NULL);
+			return;
+		}
+		if(player->mixerResync.exchange(false))
+			mixerRing.skipAll();
+		size_t c = mixerRing.read(samples, sampleNum);
+		if(c < sampleNum) {
+			memset(samples + c, 0, (sampleNum - c) * sizeof(OUTSAMPLE_t));
+			player->mixerUnderruns++;
+		}
+	}
+
+	// In whole frames, otherwise the channels would drift through the ring.
+	size_t msToSamples(size_t ms) const {
+		return (ms * player->outSamplerate / 1000) * player->outNumChannels;
+	}
+
+	void mixerThreadProc(std::atomic<bool>& stopSignal) {
+		setCurThreadName("musicplayer.so mixer");
+		PlayerStats::setCurThread(PlayerStats::T_Output);
+		setRealtime(MIXER_BLOCK_MS, "mixer");
+		std::vector<OUTSAMPLE_t> buffer(msToSamples(MIXER_BLOCK_MS));
+		mlock(&buffer[0], buffer.size() * sizeof(OUTSAMPLE_t));
+		while(!stopSignal) {
+			if(mixerRing.freeSpace() < buffer.size()) {
+				usleep(MIXER_BLOCK_MS * 1000 / 2);
+				continue;
+			}
+			player->readOutStream(&buffer[0], buffer.size(), NULL);
+			mixerRing.write(&buffer[0], buffer.size());
+		}
+	}
+
 	static int paStreamCallback(
 		const void *input, void *output,
 		unsigned long frameCount,
@@ -106,12 +169,15 @@ struct PlayerObject::OutStream {
 		PlayerObject* player = outStream->player;
 
 		if(outStream->needRealtimeReset.exchange(false))
-			setRealtime(1000.0 * frameCount / player->outSamplerate);
+			setRealtime(1000.0 * frameCount / player->outSamplerate, "audio");
 
-		if(outStream->setThreadName.exchange(false))
+		if(outStream->setThreadName.exchange(false)) {
 			setCurThreadName("audio callback");
+			PlayerStats::setCurThread(PlayerStats::T_Output);
+		}
 
 		if(statusFlags & paOutputUnderflow) {
+			player->outUnderflows++;
 			printf("audio: paOutputUnderflow\n");
 #ifdef Apple_Debug_Instruments
 			DTSendSignalFlag("com.albertzeyer.MusicPlayer.audioUnderflow", DT_POINT_SIGNAL, TRUE);
@@ -123,24 +189,34 @@ struct PlayerObject::OutStream {
 		// We must not hold the PyGIL here!
 		// Also no need to hold the player lock, all is safe!
 
-		player->readOutStream((OUTSAMPLE_t*) output, frameCount * outStream->player->outNumChannels, NULL);
+		double startTime = monotonicTime();
+		outStream->readOut((OUTSAMPLE_t*) output, frameCount * outStream->player->outNumChannels);
+		if(monotonicTime() - startTime > LATENCY_SLOW_CALLBACK * frameCount / player->outSamplerate)
+			player->outSlowCallbacks++;
 		return paContinue;
 	}
-#else
-	PyThread audioThread;
+
 	void audioThreadProc(std::atomic<bool>& stopSignal) {
-		std::vector<OUTSAMPLE_t> buffer(20 /* ms */ * player->outNumChannels * player->outSamplerate / 1000);
+		PaStream* stream = this->stream; // close() resets it before it stops us
+		std::vector<OUTSAMPLE_t> buffer(player->outBlockMs * player->outNumChannels * player->outSamplerate / 1000);
+		mlock(&buffer[0], buffer.size() * sizeof(OUTSAMPLE_t));
 		size_t frameCount = buffer.size() / player->outNumChannels;
+		setCurThreadName("musicplayer.so audio");
+		PlayerStats::setCurThread(PlayerStats::T_Output);
 		while(true) {
 			if(stopSignal) return;
 
 			if(needRealtimeReset.exchange(false))
-				setRealtime(1000.0 * frameCount / player->outSamplerate);
+				setRealtime(1000.0 * frameCount / player->outSamplerate, "audio");
 
-			player->readOutStream(&buffer[0], frameCount * player->outNumChannels, NULL);
+			double startTime = monotonicTime();
+			readOut(&buffer[0], frameCount * player->outNumChannels);
+			if(monotonicTime() - startTime > LATENCY_SLOW_CALLBACK * frameCount / player->outSamplerate)
+				player->outSlowCallbacks++;
 
 			PaError ret = Pa_WriteStream(stream, &buffer[0], frameCount);
 			if(ret == paOutputUnderflowed) {
+				player->outUnderflows++;
 				printf("warning: paOutputUnderflowed\n");
 #ifdef Apple_Debug_Instruments
 				DTSendSignalFlag("com.albertzeyer.MusicPlayer.audioUnderflow", DT_POINT_SIGNAL, TRUE);
@@ -156,7 +232,6 @@ struct PlayerObject::OutStream {
 			}
 		}
 	}
-#endif
 
 	static PaDeviceIndex selectSoundDevice(const std::string& preferredSoundDevice) {
 		int num = Pa_GetDeviceCount();
@@ -199,11 +274,26 @@ struct PlayerObject::OutStream {
 		return -1;
 	}
 
-	bool open(const std::string& prefferedSoundDevice) {
+#ifdef __linux__
+	// Lets the ALSA host API of PortAudio create its thread with SCHED_FIFO.
+	// Only in newer PortAudio builds with ALSA, thus we check via dlsym.
+	// We try it also ourselves in setRealtime() from the callback thread.
+	void enableAlsaRealtimeScheduling() {
+		const PaDeviceInfo* devInfo = Pa_GetDeviceInfo(soundDeviceIdx);
+		const PaHostApiInfo* apiInfo = devInfo ? Pa_GetHostApiInfo(devInfo->hostApi) : NULL;
+		if(!apiInfo || apiInfo->type != paALSA) return;
+		typedef void Func(PaStream*, int);
+		static Func* func = (Func*) dlsym(RTLD_DEFAULT, "PaAlsa_EnableRealtimeScheduling");
+		if(func) func(stream, 1);
+	}
+#endif
+
+	// reinitPortAudio=false if we know that the device is the same, see adaptOutLatency().
+	bool open(const std::string& prefferedSoundDevice, bool reinitPortAudio = true) {
 		if(stream) return true;
 		assert(stream == NULL);
 
-		if(PaStreamInstanceCounter == 0)
+		if(reinitPortAudio && PaStreamInstanceCounter == 0 && !player->fastStart)
 			// maybe we get a new list of devices
 			reinitPlayerOutput();
 
@@ -217,11 +307,6 @@ struct PlayerObject::OutStream {
 		PaMacCore_SetupStreamInfo( &macInfo,
 			paMacCorePlayNice | paMacCorePro | paMacCoreChangeDeviceParameters );
 		outputParameters.hostApiSpecificStreamInfo = &macInfo;
-#elif defined(__LINUX__)
-		// TODO: if we have PaAlsa_EnableRealtimeScheduling in portaudio,
-		// we can call that to enable RT priority with ALSA.
-		// We could check dynamically via dsym.
-		outputParameters.hostApiSpecificStreamInfo = NULL;
 #else
 		outputParameters.hostApiSpecificStreamInfo = NULL;
 #endif
@@ -257,13 +342,14 @@ struct PlayerObject::OutStream {
 		 Now I ended up with 20ms which seems to work really good, i.e.
 		 no issues in quality and also no underflows.
 
-		 I hope this is a good generic setting. If so, I like to have it just hardcoded.
-		 If it is still bad for some people, it might make sense to make this
-		 configurable.
+		 It still behaves quite differently across devices (e.g. USB vs onboard),
+		 thus it is configurable via player.outLatencyMs, and player.adaptiveLatency
+		 adjusts it at runtime, see PlayerObject::adaptOutLatency().
 		 */
-		const long LATENCY_IN_MS = 20;
 		unsigned long framesPerBuffer = paFramesPerBufferUnspecified; // support any buffer size
-		outputParameters.suggestedLatency = LATENCY_IN_MS / 1000.0;
+		outputParameters.suggestedLatency = player->outLatencyCurMs / 1000.0;
+
+		blocking = player->outBlocking;
 
 		while(true) {
 			PaError ret = Pa_OpenStream(
@@ -273,11 +359,7 @@ struct PlayerObject::OutStream {
 				player->outSamplerate, // sampleRate
 				framesPerBuffer,
 				paClipOff | paDitherOff,
-#if USE_PORTAUDIO_CALLBACK
-				&paStreamCallback,
-#else
-				NULL,
-#endif
+				blocking ? NULL : &paStreamCallback,
 				this //void *userData
 				);
 
@@ -300,14 +382,29 @@ struct PlayerObject::OutStream {
 			break;
 		}
 
+		const PaStreamInfo* streamInfo = Pa_GetStreamInfo(stream);
+		player->outActualLatency = streamInfo ? streamInfo->outputLatency : 0;
+
+#ifdef __linux__
+		enableAlsaRealtimeScheduling();
+#endif
+
+		// Start the mixer first, so that the ring is filled when the audio thread starts.
+		useMixer = player->mixAheadMs > 0;
+		if(useMixer) {
+			size_t block = msToSamples(MIXER_BLOCK_MS);
+			size_t ahead = msToSamples(player->mixAheadMs);
+			mixerRing.reset(std::max(ahead, 2 * block));
+			player->mixerResync = false; // nothing old in there
+			mixerThread.start();
+		}
+
 		needRealtimeReset = true;
 		setThreadName = true;
 		Pa_StartStream(stream);
 
-#if !USE_PORTAUDIO_CALLBACK
-		audioThread.func = std::bind(&OutStream::audioThreadProc, this, _1);
-		audioThread.start();
-#endif
+		if(blocking)
+			audioThread.start();
 		return true;
 	}
 
@@ -320,13 +417,13 @@ struct PlayerObject::OutStream {
 		PaStream* stream = NULL;
 		std::swap(stream, this->stream);
 		PyScopedUnlock unlock(player->lock);
-#if !USE_PORTAUDIO_CALLBACK
 		audioThread.stop();
-#endif
 		if(waitForPendingAudioBuffers)
 			Pa_StopStream(stream);
 		Pa_CloseStream(stream);
 		PaStreamInstanceCounter--;
+		mixerThread.stop();
+		useMixer = false;
 	}
 
 	bool isOpen() const { return stream != NULL; }
@@ -335,10 +432,23 @@ struct PlayerObject::OutStream {
 
 
 
+void PlayerObject::waitOutStreamOpening() {
+	// We expect to hold the player lock.
+	LockProfilerSpinWait spinWait("outStreamOpening");
+	while(outStreamOpening) {
+		spinWait.spin();
+		PyScopedUnlock unlock(this->lock);
+		usleep(100);
+	}
+	spinWait.finish();
+}
+
 bool PlayerObject::openOutStream() {
 	if(!soundcardOutputEnabled)
 		return true;
 
+	waitOutStreamOpening();
+
 	if(!outStream.get())
 		outStream.reset(new OutStream(this));
 	assert(outStream.get() != NULL);
@@ -351,7 +461,99 @@ bool PlayerObject::isOutStreamOpen() {
 	return outStream->isOpen();
 }
 
+// Called regularly by the worker. Raises the latency after underflows (or many
+// slow callbacks), which needs a reopen of the output stream while playing.
+// Lowers it again after a while without underflows, but to avoid a hiccup,
+// that is only applied with the next open. Also when we are not playing:
+// then the stream is only open for the fade-out, and a reopen would cut it.
+void PlayerObject::adaptOutLatency() {
+	double now = monotonicTime();
+	if(now - latencyLastCheck < LATENCY_CHECK_SECS) return;
+	latencyLastCheck = now;
+	uint64_t underflows = outUnderflows, slowCallbacks = outSlowCallbacks;
+	uint64_t newUnderflows = underflows - latencyUnderflowsSeen;
+	uint64_t newSlowCallbacks = slowCallbacks - latencySlowCallbacksSeen;
+	latencyUnderflowsSeen = underflows;
+	latencySlowCallbacksSeen = slowCallbacks;
+	if(!adaptiveLatency) return;
+
+	PyScopedLock lock(this->lock);
+	if(!soundcardOutputEnabled || outStreamOpening || !isOutStreamOpen()) return;
+	int oldMs = outLatencyCurMs;
+	const char* reason = NULL;
+	if(newUnderflows > 0 || newSlowCallbacks > LATENCY_MAX_SLOW_CALLBACKS) {
+		latencyLastRaise = now;
+		if(oldMs >= outLatencyMaxMs) return;
+		outLatencyCurMs = std::min(outLatencyMaxMs, std::max(oldMs + 1, int(oldMs * LATENCY_RAISE_FACTOR)));
+		reason = newUnderflows > 0 ? "underflow" : "slow callbacks";
+	}
+	else if(oldMs > outLatencyMs && now - latencyLastRaise > LATENCY_LOWER_AFTER_SECS) {
+		latencyLastRaise = now; // wait again before the next step
+		outLatencyCurMs = std::max(outLatencyMs, int(oldMs * LATENCY_LOWER_FACTOR));
+		reason = "stable";
+	}
+	if(!reason) return;
+
+	LatencyDecision decision;
+	decision.time = now;
+	decision.oldMs = oldMs;
+	decision.newMs = outLatencyCurMs;
+	decision.reason = reason;
+	if(latencyDecisions.size() >= LATENCY_MAX_DECISIONS)
+		latencyDecisions.erase(latencyDecisions.begin());
+	latencyDecisions.push_back(decision);
+	printf("audio: latency %ims -> %ims (%s)\n", oldMs, outLatencyCurMs, reason);
+
+	if(outLatencyCurMs > oldMs && playing) {
+		// close() releases the player lock. Keep everyone else off the stream, see waitOutStreamOpening().
+		outStreamOpening = true;
+		auto stream = outStream; // copy in case someone else wants to free it
+		stream->close(false);
+		if(!stream->open(preferredSoundDevice, false /* same device */)) {
+			PyScopedGIL gil;
+			PyErr_Print();
+		}
+		outStreamOpening = false;
+	}
+}
+
+PyObject* PlayerObject::outLatencyStats() {
+	std::vector<LatencyDecision> decisions;
+	int configuredMs, curMs;
+	Py_BEGIN_ALLOW_THREADS
+	{
+		PyScopedLock lock(this->lock);
+		decisions = latencyDecisions;
+		configuredMs = outLatencyMs;
+		curMs = outLatencyCurMs;
+	}
+	Py_END_ALLOW_THREADS
+
+	PyObject* stats = PyDict_New();
+	if(!stats) return NULL;
+	PyDict_SetItemString_retain(stats, "outputMode", PyString_FromString(outBlocking ? "blocking" : "callback"));
+	PyDict_SetItemString_retain(stats, "configuredMs", PyInt_FromLong(configuredMs));
+	PyDict_SetItemString_retain(stats, "currentMs", PyInt_FromLong(curMs));
+	PyDict_SetItemString_retain(stats, "actualSecs", PyFloat_FromDouble(outActualLatency));
+	PyDict_SetItemString_retain(stats, "underflows", PyLong_FromUnsignedLongLong(outUnderflows));
+	PyDict_SetItemString_retain(stats, "slowCallbacks", PyLong_FromUnsignedLongLong(outSlowCallbacks));
+	PyObject* l = PyList_New(decisions.size());
+	if(!l) {
+		Py_DECREF(stats);
+		return NULL;
+	}
+	for(size_t i = 0; i < decisions.size(); ++i)
+		PyList_SET_ITEM(l, i, Py_BuildValue("{s:d,s:i,s:i,s:s}",
+			"time", decisions[i].time,
+			"oldMs", decisions[i].oldMs,
+			"newMs", decisions[i].newMs,
+			"reason", decisions[i].reason));
+	PyDict_SetItemString_retain(stats, "decisions", l);
+	return stats;
+}
+
 void PlayerObject::closeOutStream(bool waitForPendingAudioBuffers) {
+	waitOutStreamOpening();
 	if(!outStream.get()) return;
 	if(!outStream->isOpen()) return;
 	auto stream = outStream; // copy in case someone else wants to free it
@@ -364,7 +566,7 @@ int PlayerObject::setPlaying(bool playing) {
 	bool oldplayingstate = player->playing;
 
 	if(oldplayingstate != playing)
-		outOfSync = true;
+		outOfSync = mixerResync = true;
 
 	PyScopedGIL gil;
 	{
@@ -373,7 +575,23 @@ int PlayerObject::setPlaying(bool playing) {
 		if(playing)
 			startWorkerThread(); // if not running yet, start
 
-		if(playing && !openOutStream())
+		if(playing && fastStart && soundcardOutputEnabled) {
+			waitOutStreamOpening();
+			outStreamOpening = true;
+			if(!outStream.get())
+				outStream.reset(new OutStream(this));
+			auto stream = outStream; // copy, we don't hold the lock
+			bool opened = false;
+			{
+				// The worker can open and decode the first song meanwhile.
+				PyScopedUnlock unlock(this->lock);
+				opened = stream->open(preferredSoundDevice);
+			}
+			outStreamOpening = false;
+			if(!opened)
+				playing = false;
+		}
+		else if(playing && !openOutStream())
 			playing = false;
 
 		if(soundcardOutputEnabled && player->outStream.get() && player->outStream->isOpen() && oldplayingstate != playing)
@@ -382,27 +600,10 @@ int PlayerObject::setPlaying(bool playing) {
 	}
 
 	if(!PyErr_Occurred() && player->dict) {
-		Py_INCREF(player->dict);
-		PyObject* onPlayingStateChange = PyDict_GetItemString(player->dict, "onPlayingStateChange");
-		if(onPlayingStateChange && onPlayingStateChange != Py_None) {
-			Py_INCREF(onPlayingStateChange);
-
-			PyObject* kwargs = PyDict_New();
-			assert(kwargs);
-			PyDict_SetItemString_retain(kwargs, "oldState", PyBool_FromLong(oldplayingstate));
-			PyDict_SetItemString_retain(kwargs, "newState", PyBool_FromLong(playing));
-
-			PyObject* retObj = PyEval_CallObjectWithKeywords(onPlayingStateChange, NULL, kwargs);
-			Py_XDECREF(retObj);
-
-			// errors are not fatal from the callback, so handle it now and go on
-			if(PyErr_Occurred())
-				PyErr_Print();
-
-			Py_DECREF(kwargs);
-			Py_DECREF(onPlayingStateChange);
-		}
-		Py_DECREF(player->dict);
+		PlayerEvent ev(PlayerEvent::PlayingStateChange);
+		ev.oldState = oldplayingstate;
+		ev.newState = playing;
+		player->pushEvent(ev);
 	}
 
 	return PyErr_Occurred() ? -1 : 0;
@@ -411,6 +612,7 @@ int PlayerObject::setPlaying(bool playing) {
 void PlayerObject::resetPlaying() {
 	if(this->playing)
 		this->setPlaying(false);
+	waitOutStreamOpening();
 	if(this->outStream.get() != NULL)
 		this->outStream.reset();
 	reinitPlayerOutput();
@@ -431,7 +633,7 @@ std::string PlayerObject::getSoundDevice() {
 // https://developer.apple.com/library/mac/#documentation/Darwin/Conceptual/KernelProgramming/scheduler/scheduler.html
 // Also, from Google Native Client, osx/nacl_thread_nice.c has some related code.
 // Or, from Google Chrome, platform_thread_mac.mm. http://src.chromium.org/svn/trunk/src/base/threading/platform_thread_mac.mm
-void setRealtime(double dutyCicleMs) {
+void setRealtime(double dutyCicleMs, const char* thread) {
 	kern_return_t ret;
 	thread_port_t threadport = pthread_mach_thread_np(pthread_self());
 
@@ -480,9 +682,12 @@ void setRealtime(double dutyCicleMs) {
 		fprintf(stderr, "setRealtime() THREAD_TIME_CONSTRAINT_POLICY failed: %d, %s\n", ret, mach_error_string(ret));
 		return;
 	}
+	setRealtimeSchedulingInfo(thread, RealtimeSched_MacTimeConstraint);
 }
 #else
-void setRealtime(double dutyCicleMs) {} // not implemented yet
+void setRealtime(double dutyCicleMs, const char* thread) {
+	setCurThreadRealtimeLinux(thread);
+}
 #endif
 
 
@@ -0,0 +1,345 @@
+// musicplayer_player_sinks.cpp
+// part of MusicPlayer, https://github.com/albertz/music-player
+// Copyright (c) 2012, Albert Zeyer, www.az2000.de
+// All rights reserved.
+// This code is under the 2-clause BSD license, see License.txt in the root directory of this project.
+
+// Sinks are native threads which pull readOutStream() instead of the sound card.
+// They need soundcardOutputEnabled = False. Only one sink runs at a time.
+// The virtual sink calls it like an audio callback, in real time or N times
+// real time, without any audio hardware. Thus the playback pipeline can be
+// benchmarked and tested on headless machines.
+// The render sink writes the output to a WAV/raw file or fd, as fast as the
+// decoding allows, without any gaps.
+
+#include "musicplayer.h"
+#include "PyUtils.h"
+#include "PythonHelpers.h"
+#include "Py3Compat.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+
+PlayerObject::Sink::Sink(PlayerObject* p)
+: player(p), blocks(0), frames(0), underruns(0), lateBlocks(0), startTime(0), busySecs(0), maxBlockSecs(0) {
+	thread.func = [this](std::atomic<bool>& stopSignal) {
+		PlayerStats::setCurThread(PlayerStats::T_Output);
+		startTime = monotonicTime();
+		proc(stopSignal);
+	};
+}
+
+void PlayerObject::Sink::recordBlock(size_t frameNum, double secs, bool underrun, bool late) {
+	// Only this thread writes these.
+	blocks++;
+	frames += frameNum;
+	if(underrun) underruns++;
+	if(late) lateBlocks++;
+	busySecs = busySecs + secs;
+	if(secs > maxBlockSecs) maxBlockSecs = secs;
+}
+
+PyObject* PlayerObject::Sink::stats() {
+	PyObject* dict = PyDict_New();
+	if(!dict) return NULL;
+	double wallSecs = startTime > 0 ? monotonicTime() - startTime : 0;
+	double audioSecs = double(frames) / player->outSamplerate;
+	PyDict_SetItemString_retain(dict, "type", PyString_FromString(type()));
+	PyDict_SetItemString_retain(dict, "running", PyBool_FromLong(thread.running));
+	PyDict_SetItemString_retain(dict, "blocks", PyLong_FromUnsignedLongLong(blocks));
+	PyDict_SetItemString_retain(dict, "frames", PyLong_FromUnsignedLongLong(frames));
+	PyDict_SetItemString_retain(dict, "underruns", PyLong_FromUnsignedLongLong(underruns));
+	PyDict_SetItemString_retain(dict, "lateBlocks", PyLong_FromUnsignedLongLong(lateBlocks));
+	PyDict_SetItemString_retain(dict, "audioSecs", PyFloat_FromDouble(audioSecs));
+	PyDict_SetItemString_retain(dict, "wallSecs", PyFloat_FromDouble(wallSecs));
+	// Audio time per wall time, e.g. 1 for real time.
+	PyDict_SetItemString_retain(dict, "speed", PyFloat_FromDouble(wallSecs > 0 ? audioSecs / wallSecs : 0));
+	PyDict_SetItemString_retain(dict, "blockSecsAvg", PyFloat_FromDouble(blocks > 0 ? busySecs / blocks : 0));
+	PyDict_SetItemString_retain(dict, "blockSecsMax", PyFloat_FromDouble(maxBlockSecs));
+	if(!addStats(dict)) {
+		Py_DECREF(dict);
+		return NULL;
+	}
+	return dict;
+}
+
+
+// Pulls readOutStream() like the PortAudio callback, i.e. it fills silence
+// if the worker is behind, and that counts as underrun.
+// As fast as possible (speed <= 0), it would only spin and count silence,
+// so then it takes only the available data, like RenderSink, and waits for more.
+struct VirtualSink : PlayerObject::Sink {
+	double speed; // 1 is real time. <= 0 means as fast as possible
+	size_t blockFrames;
+
+	VirtualSink(PlayerObject* p, double _speed, size_t _blockFrames)
+	: Sink(p), speed(_speed), blockFrames(_blockFrames) {}
+	~VirtualSink() { thread.stop(); }
+
+	const char* type() const { return "virtual"; }
+
+	void proc(std::atomic<bool>& stopSignal) {
+		setCurThreadName("musicplayer.so virtual sink");
+		std::vector<OUTSAMPLE_t> buffer(blockFrames * player->outNumChannels);
+		mlock(&buffer[0], buffer.size() * sizeof(OUTSAMPLE_t));
+		double period = double(blockFrames) / player->outSamplerate;
+		if(speed > 0) period /= speed;
+		bool started = false; // the silence until the first pre-roll is not an underrun
+		double nextTime = monotonicTime();
+
+		while(!stopSignal) {
+			double startTime = monotonicTime();
+			if(speed <= 0) {
+				size_t sampleNumOut = 0;
+				{
+					PyScopedLock lock(player->lock);
+					if(player->playing)
+						player->readOutStream(&buffer[0], buffer.size(), &sampleNumOut);
+				}
+				if(sampleNumOut == 0) {
+					usleep(1000); // the worker is behind, or nothing to render
+					continue;
+				}
+				recordBlock(sampleNumOut / player->outNumChannels, monotonicTime() - startTime, false, false);
+				continue;
+			}
+
+			bool complete = player->readOutStream(&buffer[0], buffer.size(), NULL);
+			double secs = monotonicTime() - startTime;
+			if(complete) started = true;
+			recordBlock(blockFrames, secs, started && !complete && player->playing, secs > period);
+
+			nextTime += period;
+			double now = monotonicTime();
+			if(now < nextTime)
+				usleep(useconds_t((nextTime - now) * 1000000));
+			else if(now - nextTime > period)
+				// We are more than a block behind. Don't try to catch up in a burst.
+				nextTime = now;
+		}
+	}
+
+	bool addStats(PyObject* dict) {
+		PyDict_SetItemString_retain(dict, "targetSpeed", PyFloat_FromDouble(speed));
+		PyDict_SetItemString_retain(dict, "blockFrames", PyLong_FromSize_t(blockFrames));
+		return true;
+	}
+};
+
+
+// Like readOutStream() from Python, it only takes the available data, thus
+// there are no gaps if the worker is behind. It stops after maxSecs, or when
+// there was no data for idleTimeoutSecs (e.g. the queue is empty).
+// We write the samples in native byte order, i.e. the WAV file is only
+// correct on little-endian hosts.
+struct RenderSink : PlayerObject::Sink {
+	int fd;
+	bool ownFd;
+	bool wav;
+	size_t blockFrames;
+	double maxSecs, idleTimeoutSecs;
+	std::atomic<uint64_t> bytesWritten;
+	std::atomic<uint64_t> headerSize; // of bytesWritten
+	std::string finishReason; // set by the thread when it finished
+	std::atomic<bool> finished;
+
+	RenderSink(PlayerObject* p, int _fd, bool _ownFd, bool _wav, size_t _blockFrames, double _maxSecs, double _idleTimeoutSecs)
+	: Sink(p), fd(_fd), ownFd(_ownFd), wav(_wav), blockFrames(_blockFrames),
+	maxSecs(_maxSecs), idleTimeoutSecs(_idleTimeoutSecs), bytesWritten(0), headerSize(0), finished(false) {}
+	~RenderSink() {
+		thread.stop();
+		if(ownFd && fd >= 0) ::close(fd);
+	}
+
+	const char* type() const { return "render"; }
+
+	bool writeAll(const void* data, size_t size) {
+		const uint8_t* p = (const uint8_t*) data;
+		while(size > 0) {
+			ssize_t ret = ::write(fd, p, size);
+			if(ret < 0 && errno == EINTR) continue;
+			if(ret <= 0) return false;
+			p += ret;
+			size -= ret;
+			bytesWritten += ret;
+		}
+		return true;
+	}
+
+	// The RIFF and data chunk sizes are unknown until the end. For pipes, they stay at
+	// the maximum, which most readers interpret as "until EOF".
+	bool writeWavHeader(uint32_t dataSize) {
+		struct {
+			char riff[4]; uint32_t riffSize; char wave[4];
+			char fmt[4]; uint32_t fmtSize;
+			uint16_t format, channels; uint32_t samplerate, byteRate; uint16_t blockAlign, bitsPerSample;
+			char data[4]; uint32_t dataSize;
+		} __attribute__((packed)) h;
+		memcpy(h.riff, "RIFF", 4);
+		h.riffSize = dataSize == 0xffffffff ? dataSize : dataSize + 36;
+		memcpy(h.wave, "WAVE", 4);
+		memcpy(h.fmt, "fmt ", 4);
+		h.fmtSize = 16;
+		h.format = (OUTSAMPLE_t(0.5) == 0) ? 1 /* PCM */ : 3 /* IEEE float */;
+		h.channels = player->outNumChannels;
+		h.samplerate = player->outSamplerate;
+		h.byteRate = player->outSamplerate * player->outNumChannels * OUTSAMPLEBYTELEN;
+		h.blockAlign = player->outNumChannels * OUTSAMPLEBYTELEN;
+		h.bitsPerSample = OUTSAMPLEBITLEN;
+		memcpy(h.data, "data", 4);
+		h.dataSize = dataSize;
+		static_assert(sizeof(h) == 44, "WAV header size");
+		return writeAll(&h, sizeof(h));
+	}
+
+	void finish(const std::string& reason) {
+		finishReason = reason;
+		finished = true;
+	}
+
+	void proc(std::atomic<bool>& stopSignal) {
+		setCurThreadName("musicplayer.so render sink");
+		// -1 if we cannot seek. A caller supplied fd might not be at the start.
+		off_t headerPos = lseek(fd, 0, SEEK_CUR);
+		if(wav) {
+			headerSize = 44; // see writeWavHeader()
+			if(!writeWavHeader(0xffffffff)) {
+				finish(std::string("write error: ") + strerror(errno));
+				return;
+			}
+		}
+		std::vector<OUTSAMPLE_t> buffer(blockFrames * player->outNumChannels);
+		uint64_t maxFrames = maxSecs > 0 ? uint64_t(maxSecs * player->outSamplerate) : 0;
+		double lastDataTime = monotonicTime();
+
+		while(true) {
+			if(stopSignal) {
+				finish("stopped");
+				break;
+			}
+			size_t sampleNum = buffer.size();
+			if(maxFrames && frames + blockFrames > maxFrames)
+				sampleNum = (maxFrames - frames) * player->outNumChannels;
+			if(sampleNum == 0) {
+				finish("maxSecs");
+				break;
+			}
+
+			double startTime = monotonicTime();
+			size_t sampleNumOut = 0;
+			{
+				PyScopedLock lock(player->lock);
+				if(player->playing)
+					player->readOutStream(&buffer[0], sampleNum, &sampleNumOut);
+			}
+			if(sampleNumOut == 0) {
+				if(startTime - lastDataTime > idleTimeoutSecs) {
+					finish("idle");
+					break;
+				}
+				usleep(1000); // the worker is behind
+				continue;
+			}
+			lastDataTime = startTime;
+			if(!writeAll(&buffer[0], sampleNumOut * OUTSAMPLEBYTELEN)) {
+				finish(std::string("write error: ") + strerror(errno));
+				break;
+			}
+			recordBlock(sampleNumOut / player->outNumChannels, monotonicTime() - startTime, false, false);
+		}
+
+		// Now that we know the size, fix the header, if we can seek.
+		uint64_t dataSize = bytesWritten - headerSize;
+		if(wav && dataSize < 0xffffffff - 36 && headerPos >= 0 && lseek(fd, headerPos, SEEK_SET) == headerPos) {
+			uint64_t total = bytesWritten;
+			writeWavHeader((uint32_t) dataSize);
+			bytesWritten = total;
+			// A caller supplied fd stays open, so it must be at the end again.
+			lseek(fd, 0, SEEK_END);
+		}
+	}
+
+	bool addStats(PyObject* dict) {
+		PyDict_SetItemString_retain(dict, "format", PyString_FromString(wav ? "wav" : "raw"));
+		PyDict_SetItemString_retain(dict, "bytesWritten", PyLong_FromUnsignedLongLong(bytesWritten));
+		double wallSecs = startTime > 0 ? monotonicTime() - startTime : 0;
+		uint64_t total = bytesWritten, header = headerSize;
+		uint64_t dataBytes = total > header ? total - header : 0;
+		// In bytes per second, of the audio data.
+		PyDict_SetItemString_retain(dict, "throughput", PyFloat_FromDouble(wallSecs > 0 ? dataBytes / wallSecs : 0));
+		if(finished)
+			PyDict_SetItemString_retain(dict, "finished", PyString_FromString(finishReason.c_str()));
+		else
+			PyDict_SetItemString(dict, "finished", Py_None);
+		return true;
+	}
+};
+
+
+bool PlayerObject::startSink(std::shared_ptr<Sink> newSink) {
+	// We expect to hold the player lock, but not the GIL.
+	if(soundcardOutputEnabled) {
+		PyScopedGIL gil;
+		PyErr_SetString(PyExc_RuntimeError, "cannot use a sink with soundcardOutputEnabled");
+		return false;
+	}
+	stopSink();
+	sink = newSink;
+	startWorkerThread(); // if not running yet, start
+	sink->thread.start();
+	return true;
+}
+
+void PlayerObject::stopSink() {
+	// We expect to hold the player lock, but not the GIL.
+	std::shared_ptr<Sink> oldSink;
+	oldSink.swap(sink);
+	if(!oldSink) return;
+	{
+		// The sink threads take the player lock (and potentially wait for the GIL
+		// in there), so release it while we join.
+		PyScopedUnlock unlock(this->lock);
+		oldSink->thread.stop();
+	}
+	lastSink = oldSink; // for sinkStats
+}
+
+bool PlayerObject::startVirtualSink(double speed, size_t blockFrames) {
+	return startSink(std::make_shared<VirtualSink>(this, speed, blockFrames));
+}
+
+bool PlayerObject::startRenderSink(const std::string& filename, int fd, bool wav, size_t blockFrames, double maxSecs, double idleTimeoutSecs) {
+	// We expect to hold the player lock, but not the GIL.
+	bool ownFd = false;
+	if(!filename.empty()) {
+		fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0) {
+			PyScopedGIL gil;
+			PyErr_Format(PyExc_IOError, "cannot open %s: %s", filename.c_str(), strerror(errno));
+			return false;
+		}
+		ownFd = true;
+	}
+	std::shared_ptr<Sink> s = std::make_shared<RenderSink>(this, fd, ownFd, wav, blockFrames, maxSecs, idleTimeoutSecs);
+	return startSink(s);
+}
+
+PyObject* PlayerObject::sinkStats() {
+	std::shared_ptr<Sink> s;
+	Py_BEGIN_ALLOW_THREADS
+	{
+		PyScopedLock lock(this->lock);
+		s = sink ? sink : lastSink;
+	}
+	Py_END_ALLOW_THREADS
+	if(!s) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	return s->stats();
+}
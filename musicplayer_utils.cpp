@@ -8,6 +8,7 @@
 #include "Protection.hpp"
 #include "PyUtils.h"
 #include <unistd.h>
+#include <chrono>
 
 
 
@@ -93,6 +94,29 @@ std::string objStr(PyObject* obj) {
 	return s2;
 }
 
+std::string songUrl(PyObject* song) {
+	PyScopedGIL gstate;
+	std::string url;
+	PyObject* urlObj = PyObject_GetAttrString(song, "url");
+	if(!urlObj) {
+		PyErr_Clear();
+		return url;
+	}
+	if(PyUnicode_Check(urlObj)) {
+		PyObject* bytes = PyUnicode_AsUTF8String(urlObj);
+		if(bytes) {
+			url.assign(PyBytes_AS_STRING(bytes), PyBytes_GET_SIZE(bytes));
+			Py_DECREF(bytes);
+		}
+		else
+			PyErr_Clear();
+	}
+	else if(PyBytes_Check(urlObj))
+		url.assign(PyBytes_AS_STRING(urlObj), PyBytes_GET_SIZE(urlObj));
+	Py_DECREF(urlObj);
+	return url;
+}
+
 
 
 
@@ -111,24 +135,64 @@ void* getStackPtr(int n) {
 	return stack[n];
 }
 
-const char* getStackSymbol(void* pt) {
+std::string getStackSymbol(void* pt) {
 	char** s_ = backtrace_symbols(&pt, 1);
 	if(!s_) return "?";
-	char* s = *s_;
-	free(s_);
-	if(!s) return "?";
+	const char* s = *s_;
+	if(!s) {
+		free(s_);
+		return "?";
+	}
 	// s = "<number>     <filename>    <interesting-part>"
 	// we only want the interesting part.
 	while(*s && *s != ' ') ++s; // advance the number
 	while(*s && *s == ' ') ++s; // advance the spaces
 	while(*s && *s != ' ') ++s; // advance the filename
 	while(*s && *s == ' ') ++s; // advance the spaces
-	return s;
+	std::string symbol(s);
+	free(s_); // also frees the strings
+	return symbol;
+}
+
+#elif defined(__GLIBC__)
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <string.h>
+#include <stdio.h>
+
+__attribute__((noinline))
+void* getStackPtr(int n) {
+	n += 1; // getStackPtr() itself
+	void* stack[20];
+	static const int Size = sizeof(stack)/sizeof(stack[0]);
+	if(n >= Size) return NULL;
+	int c = backtrace(stack, Size);
+	if(n >= c) return NULL;
+	return stack[n];
+}
+
+std::string getStackSymbol(void* pt) {
+	char buf[256];
+	Dl_info info;
+	if(!dladdr(pt, &info))
+		snprintf(buf, sizeof(buf), "%p", pt);
+	else if(info.dli_sname)
+		snprintf(buf, sizeof(buf), "%s+0x%lx",
+				 info.dli_sname, (unsigned long) ((char*) pt - (char*) info.dli_saddr));
+	else {
+		// dladdr only knows exported symbols. For static functions and lambdas, give
+		// the offset in the library, e.g. for `addr2line -f -C -e musicplayer.so <offset>`.
+		const char* fname = info.dli_fname ? strrchr(info.dli_fname, '/') : NULL;
+		fname = fname ? fname + 1 : (info.dli_fname ? info.dli_fname : "?");
+		snprintf(buf, sizeof(buf), "%s+0x%lx",
+				 fname, (unsigned long) ((char*) pt - (char*) info.dli_fbase));
+	}
+	return buf;
 }
 
 #else
 void* getStackPtr(int n) { return NULL; }
-const char* getStackSymbol(void* pt) { return "?"; }
+std::string getStackSymbol(void* pt) { return "?"; }
 #endif
 
 
@@ -138,6 +202,7 @@ PyMutex::PyMutex() {
 	l = PyThread_allocate_lock();
 	mlock(l, sizeof(int) /* some minimum size */);
 	enabled = true;
+	holderSite.store(NULL, std::memory_order_relaxed);
 }
 
 PyMutex::~PyMutex() {
@@ -145,8 +210,19 @@ PyMutex::~PyMutex() {
 }
 
 void PyMutex::lock() {
-	if(enabled)
+	if(!enabled) return;
+	if(!lockProfilerEnabled.load(std::memory_order_relaxed)) {
 		PyThread_acquire_lock(l, WAIT_LOCK);
+		return;
+	}
+	// Profiled. 2 is the caller of PyScopedLock.
+	if(!PyThread_acquire_lock(l, NOWAIT_LOCK)) {
+		void* holder = holderSite.load(std::memory_order_relaxed);
+		double startTime = monotonicTime();
+		PyThread_acquire_lock(l, WAIT_LOCK);
+		lockProfilerRecord(LockWait_Mutex, NULL, getStackPtr(2), holder, monotonicTime() - startTime);
+	}
+	holderSite.store(getStackPtr(2), std::memory_order_relaxed);
 }
 
 bool PyMutex::lock_nowait() {
@@ -163,18 +239,37 @@ void PyMutex::unlock() {
 
 PyScopedLock::PyScopedLock(PyMutex& m) : mutex(m) {
 #ifdef MUTEX_DEBUG
-	printf("%p locks %p from %s\n", (void*)PyThread_get_thread_ident(), &mutex, getStackSymbol(getStackPtr(2)));
+	printf("%p locks %p from %s\n", (void*)PyThread_get_thread_ident(), &mutex, getStackSymbol(getStackPtr(2)).c_str());
 #endif
 	mutex.lock();
 }
 
 PyScopedLock::~PyScopedLock() {
 #ifdef MUTEX_DEBUG
-	printf("%p unlocks %p from %s\n", (void*)PyThread_get_thread_ident(), &mutex, getStackSymbol(getStackPtr(2)));
+	printf("%p unlocks %p from %s\n", (void*)PyThread_get_thread_ident(), &mutex, getStackSymbol(getStackPtr(2)).c_str());
 #endif
 	mutex.unlock();
 }
 
+void PyScopedGIL::ensureProfiled() {
+#if PY_VERSION_HEX >= 0x03040000
+	// We would not wait if we have it already.
+	if(PyGILState_Check()) {
+		gstate = PyGILState_Ensure();
+		return;
+	}
+#endif
+	double startTime = monotonicTime();
+	gstate = PyGILState_Ensure();
+	// We cannot try-lock the GIL, so we only take it as contended if it took a while.
+	// Otherwise, the backtrace and recording would dominate every uncontended
+	// PyScopedGIL, e.g. the one per read in player_read_packet().
+	double waitSecs = monotonicTime() - startTime;
+	if(waitSecs < LOCKPROFILER_GIL_MIN_WAIT_SECS) return;
+	// 1 is the caller of the (inlined) PyScopedGIL constructor.
+	lockProfilerRecord(LockWait_GIL, NULL, getStackPtr(1), NULL, waitSecs);
+}
+
 PyScopedUnlock::PyScopedUnlock(PyMutex& m) : mutex(m) {
 	mutex.unlock();
 }
@@ -183,6 +278,20 @@ PyScopedUnlock::~PyScopedUnlock() {
 	mutex.lock();
 }
 
+void PyWakeup::notify() {
+	{
+		std::lock_guard<std::mutex> l(mutex);
+		pending = true;
+	}
+	cond.notify_one();
+}
+
+void PyWakeup::wait(double timeoutSecs) {
+	std::unique_lock<std::mutex> l(mutex);
+	cond.wait_for(l, std::chrono::duration<double>(timeoutSecs), [this]{ return pending; });
+	pending = false;
+}
+
 PyThread::PyThread() {
 	running = false;
 	stopSignal = false;
@@ -234,6 +343,7 @@ void PyThread::stop() {
 		if(!running) return;
 		stopSignal = true;
 	}
+	wakeup.notify();
 	wait();
 }
 
@@ -310,6 +420,11 @@ bool ProtectionScope::isValid() {
 #endif
 
 
+double monotonicTime() {
+	using namespace std::chrono;
+	return duration_cast<duration<double> >(steady_clock::now().time_since_epoch()).count();
+}
+
 void setCurThreadName(const std::string& name)
 {
 #ifdef _MSC_VER
@@ -94,7 +94,7 @@ mod = Extension(
 	depends=glob("*.h") + glob("*.hpp"),
 	extra_compile_args=["-std=c++11"],
 	undef_macros=['NDEBUG'],
-	**pkgconfig('libavutil', 'libavformat', 'libavcodec', 'libswresample', 'portaudio-2.0', 'libchromaprint'))
+	**pkgconfig('libavutil', 'libavformat', 'libavcodec', 'libswresample', 'libswscale', 'portaudio-2.0', 'libchromaprint'))
 
 setup(
 	name='musicplayer',
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+
+"""
+Measures the time from pressing play (player.playing = True) until the
+first non-silent sample, with and without player.fastStart.
+
+Without --soundcard, we read the output via player.readOutStream, so this
+works without any sound device. With --soundcard, we play via PortAudio
+and wait until player.curSongPos advances. We also report the time
+until setPlaying returned.
+
+Usage: bench-time-to-first-audio.py [--soundcard] file1 file2 ...
+The first file is played, the others are used for the peek queue.
+"""
+
+from __future__ import print_function
+import sys
+import os
+import time
+import array
+
+# Our parent path might contain a self-build musicplayer module. Use that one.
+sys.path.insert(0, os.path.abspath((os.path.dirname(__file__) or ".") + "/.."))
+
+import musicplayer
+
+NumRuns = 5
+
+
+class Song:
+	def __init__(self, fn):
+		self.url = fn
+		self.f = open(fn, "rb")
+
+	def __eq__(self, other):
+		return self.url == other.url
+
+	def readPacket(self, bufSize):
+		return self.f.read(bufSize)
+
+	def seekRaw(self, offset, whence):
+		self.f.seek(offset, whence)
+		return self.f.tell()
+
+
+def isSilent(player, data):
+	typecode = "f" if player.outSampleFormat[0] == "float" else "h"
+	samples = array.array(typecode, data)
+	return not any(samples)
+
+
+def run(files, fastStart, soundcard):
+	player = musicplayer.createPlayer()
+	player.fastStart = fastStart
+	player.soundcardOutputEnabled = soundcard
+	player.queue = (Song(fn) for fn in files[:1] * 1000)
+	player.peekQueue = lambda n: [Song(fn) for fn in files[1:n + 1]]
+
+	start = time.time()
+	player.playing = True
+	setPlayingTime = time.time() - start
+
+	if soundcard:
+		# curSongPos only advances once we really output samples.
+		while not player.curSongPos:
+			time.sleep(0.001)
+		firstSampleTime = nonSilentTime = time.time() - start
+	else:
+		# The song might start with digital silence, thus we report both.
+		firstSampleTime = nonSilentTime = None
+		chunk = player.outSamplerate * player.outNumChannels // 100  # 10ms
+		while nonSilentTime is None:
+			data = player.readOutStream(chunk)
+			if data and firstSampleTime is None:
+				firstSampleTime = time.time() - start
+			if data and not isSilent(player, data):
+				nonSilentTime = time.time() - start
+			if not data:
+				time.sleep(0.001)
+
+	player.playing = False
+	return setPlayingTime, firstSampleTime, nonSilentTime
+
+
+def main():
+	args = sys.argv[1:]
+	soundcard = "--soundcard" in args
+	files = [arg for arg in args if arg != "--soundcard"]
+	assert files, "give me some files"
+
+	for fastStart in (False, True):
+		results = [run(files, fastStart, soundcard) for i in range(NumRuns)]
+		print("fastStart=%s (best of %i runs):" % (fastStart, NumRuns))
+		for i, name in enumerate(["setPlaying returned", "first sample", "first non-silent sample"]):
+			times = [r[i] for r in results]
+			print("  %s: %.1f ms (mean %.1f ms)" % (name, min(times) * 1000, sum(times) / NumRuns * 1000))
+
+
+if __name__ == "__main__":
+	main()
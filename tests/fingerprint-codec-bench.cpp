@@ -0,0 +1,253 @@
+// Benchmark and consistency check for the Chromaprint fingerprint codec
+// (compression + base64) in ../chromaprint against the original
+// bit-by-bit BitStringWriter/BitStringReader based implementation.
+
+// compile:
+// c++ -O2 -std=c++11 -DHAVE_CONFIG_H -I../chromaprint fingerprint-codec-bench.cpp
+//   ../chromaprint/base64.cpp ../chromaprint/fingerprint_compressor.cpp ../chromaprint/fingerprint_decompressor.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sys/time.h>
+
+#include "base64.h"
+#include "fingerprint_compressor.h"
+#include "fingerprint_decompressor.h"
+#include "bit_string_reader.h"
+#include "bit_string_writer.h"
+
+
+// The original implementation, as reference.
+namespace Reference {
+
+using Chromaprint::BitStringWriter;
+using Chromaprint::BitStringReader;
+
+static const char kBase64Chars[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+static const char kBase64CharsReversed[128] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 62, 0, 0, 52,
+	53, 54, 55, 56, 57, 58, 59, 60, 61, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5,
+	6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+	25, 0, 0, 0, 0, 63, 0, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37,
+	38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 0, 0, 0, 0, 0
+};
+
+std::string Base64Encode(const std::string &orig) {
+	int size = orig.size();
+	int encoded_size = (size * 4 + 2) / 3;
+	std::string encoded(encoded_size, '\x00');
+	const unsigned char *src = (unsigned char *)orig.data();
+	std::string::iterator dest = encoded.begin();
+	while (size > 0) {
+		*dest++ = kBase64Chars[(src[0] >> 2)];
+		*dest++ = kBase64Chars[((src[0] << 4) | (--size ? (src[1] >> 4) : 0)) & 63];
+		if (size) {
+			*dest++ = kBase64Chars[((src[1] << 2) | (--size ? (src[2] >> 6) : 0)) & 63];
+			if (size) {
+				*dest++ = kBase64Chars[src[2] & 63];
+				--size;
+			}
+		}
+		src += 3;
+	}
+	return encoded;
+}
+
+std::string Base64Decode(const std::string &encoded) {
+	std::string str((3 * encoded.size()) / 4, '\x00');
+	const unsigned char *src = (const unsigned char *)encoded.data();
+	int size = encoded.size();
+	std::string::iterator dest = str.begin();
+	while (size > 0) {
+		int b0 = kBase64CharsReversed[*src++];
+		if (--size) {
+			int b1 = kBase64CharsReversed[*src++];
+			*dest++ = (b0 << 2) | (b1 >> 4);
+			if (--size) {
+				int b2 = kBase64CharsReversed[*src++];
+				*dest++ = ((b1 << 4) & 255) | (b2 >> 2);
+				if (--size) {
+					int b3 = kBase64CharsReversed[*src++];
+					*dest++ = ((b2 << 6) & 255) | b3;
+					--size;
+				}
+			}
+		}
+	}
+	return str;
+}
+
+std::string Compress(const std::vector<int32_t> &data, int algorithm) {
+	std::vector<char> bits;
+	auto process = [&](uint32_t x) {
+		int bit = 1, last_bit = 0;
+		while (x != 0) {
+			if ((x & 1) != 0) {
+				bits.push_back(bit - last_bit);
+				last_bit = bit;
+			}
+			x >>= 1;
+			bit++;
+		}
+		bits.push_back(0);
+	};
+	if (data.size() > 0) {
+		process(data[0]);
+		for (size_t i = 1; i < data.size(); i++)
+			process(data[i] ^ data[i - 1]);
+	}
+	int length = data.size();
+	std::string result(4, '\x00');
+	result[0] = algorithm & 255;
+	result[1] = (length >> 16) & 255;
+	result[2] = (length >>  8) & 255;
+	result[3] = (length      ) & 255;
+	{
+		BitStringWriter writer;
+		for (size_t i = 0; i < bits.size(); i++)
+			writer.Write(std::min(int(bits[i]), 7), 3);
+		writer.Flush();
+		result += writer.value();
+	}
+	{
+		BitStringWriter writer;
+		for (size_t i = 0; i < bits.size(); i++)
+			if (bits[i] >= 7)
+				writer.Write(int(bits[i]) - 7, 5);
+		writer.Flush();
+		result += writer.value();
+	}
+	return result;
+}
+
+std::vector<int32_t> Decompress(const std::string &data, int *algorithm) {
+	*algorithm = data[0];
+	int length =
+		((unsigned char)(data[1]) << 16) |
+		((unsigned char)(data[2]) <<  8) |
+		((unsigned char)(data[3])      );
+	BitStringReader reader(data);
+	for (int i = 0; i < 4; i++) reader.Read(8);
+	std::vector<int32_t> result(length, -1);
+	std::vector<char> bits;
+	reader.Reset();
+	for (size_t i = 0; i < result.size(); ) {
+		int bit = reader.Read(3);
+		if (bit == 0) i++;
+		bits.push_back(bit);
+	}
+	reader.Reset();
+	for (size_t i = 0; i < bits.size(); i++)
+		if (bits[i] == 7)
+			bits[i] += reader.Read(5);
+	int i = 0, last_bit = 0, value = 0;
+	for (size_t j = 0; j < bits.size(); j++) {
+		int bit = bits[j];
+		if (bit == 0) {
+			result[i] = (i > 0) ? value ^ result[i - 1] : value;
+			value = 0;
+			last_bit = 0;
+			i++;
+			continue;
+		}
+		bit += last_bit;
+		last_bit = bit;
+		value |= 1 << (bit - 1);
+	}
+	return result;
+}
+
+}
+
+
+static double currentTime() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+// Similar to real fingerprints: consecutive subfingerprints differ only in a few bits,
+// but sometimes there are bigger jumps (these produce exception bits).
+static std::vector<int32_t> randomFingerprint(size_t len) {
+	std::vector<int32_t> fp(len);
+	uint32_t x = (uint32_t) rand();
+	for(size_t i = 0; i < len; ++i) {
+		int changes = (rand() % 10 == 0) ? 16 : (rand() % 6);
+		for(int j = 0; j < changes; ++j)
+			x ^= 1u << (rand() % 32);
+		fp[i] = (int32_t) x;
+	}
+	return fp;
+}
+
+int main(int argc, char** argv) {
+	const int N = (argc > 1) ? atoi(argv[1]) : 20000;
+	srand(42);
+
+	std::vector<std::vector<int32_t> > fps(N);
+	for(int i = 0; i < N; ++i)
+		fps[i] = randomFingerprint(1 + rand() % 1000 + (i % 3 == 0 ? 0 : 500));
+	fps[0].clear(); // also cover the empty fingerprint
+
+	// consistency check first
+	Chromaprint::FingerprintCompressor compressor;
+	Chromaprint::FingerprintDecompressor decompressor;
+	for(int i = 0; i < N; ++i) {
+		std::string ref = Reference::Base64Encode(Reference::Compress(fps[i], 1));
+		std::string res = Chromaprint::Base64Encode(compressor.Compress(fps[i], 1));
+		assert(ref == res);
+		assert(Reference::Base64Decode(ref) == Chromaprint::Base64Decode(ref));
+		int algo = -1;
+		assert(decompressor.Decompress(Chromaprint::Base64Decode(res), &algo) == fps[i]);
+		assert(algo == 1);
+		if(!fps[i].empty()) {
+			int refAlgo = -1;
+			assert(Reference::Decompress(Reference::Base64Decode(ref), &refAlgo) == fps[i]);
+		}
+	}
+	printf("consistency check with %i fingerprints: ok\n", N);
+
+	// Truncated or broken fingerprints must not crash (best checked with -fsanitize=address).
+	for(int i = 1; i < N; i += 10) {
+		std::string data = compressor.Compress(fps[i], 1);
+		int algo = -1;
+		decompressor.Decompress(data.substr(0, data.size() / 2), &algo);
+		for(size_t j = 4; j < data.size(); ++j)
+			data[j] = (char) rand();
+		decompressor.Decompress(data, &algo);
+	}
+	printf("broken fingerprints check: ok\n");
+
+	std::vector<std::string> encoded(N);
+	double t;
+
+	t = currentTime();
+	for(int i = 0; i < N; ++i)
+		encoded[i] = Reference::Base64Encode(Reference::Compress(fps[i], 1));
+	printf("reference encode: %.3f sec\n", currentTime() - t);
+
+	t = currentTime();
+	for(int i = 0; i < N; ++i)
+		encoded[i] = Chromaprint::Base64Encode(compressor.Compress(fps[i], 1));
+	printf("new encode:       %.3f sec\n", currentTime() - t);
+
+	size_t sum = 0;
+	int algo = 0;
+	t = currentTime();
+	for(int i = 1; i < N; ++i)
+		sum += Reference::Decompress(Reference::Base64Decode(encoded[i]), &algo).size();
+	printf("reference decode: %.3f sec\n", currentTime() - t);
+
+	t = currentTime();
+	for(int i = 1; i < N; ++i)
+		sum -= decompressor.Decompress(Chromaprint::Base64Decode(encoded[i]), &algo).size();
+	printf("new decode:       %.3f sec\n", currentTime() - t);
+	assert(sum == 0);
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+// Benchmark for ReadAheadFile (../ReadAheadFile.cpp) over a throttled
+// local file. The throttling simulates a spinning disk or NFS: every read
+// request has a fixed latency plus a bandwidth limit. The consumer reads
+// 4KB at a time, like FFmpeg via initIoCtx(), and does some decode work
+// per read. We compare synchronous reads against the read-ahead thread,
+// sequentially and with seeks.
+
+// compile:
+// c++ -O2 -std=c++11 -I.. $(python3-config --includes) readahead-bench.cpp
+//   ../ReadAheadFile.cpp ../musicplayer_utils.cpp ../LockProfiler.cpp $(python3-config --ldflags --embed)
+//   (plus the FFmpeg flags, because of the includes in musicplayer_utils.cpp)
+
+#include "ReadAheadFile.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <vector>
+
+static const size_t kFileSize = 16 * 1024 * 1024;
+static const int kReadSize = 1024 * 4;
+static const int kLatencyUs = 2000; // per read request
+static const double kBandwidth = 50e6; // bytes per sec
+static const int kDecodeUsPer4KB = 40; // roughly MP3 decoding + resampling
+static const int kNumSeeks = 20;
+
+static void busyWait(double secs) {
+	double end = monotonicTime() + secs;
+	while(monotonicTime() < end) {}
+}
+
+static ssize_t throttledPread(int fd, void* buf, size_t size, off_t offset) {
+	usleep(kLatencyUs + (useconds_t)(size / kBandwidth * 1e6));
+	return pread(fd, buf, size, offset);
+}
+
+static uint8_t expectedByte(int64_t pos) {
+	return uint8_t((pos * 7) ^ (pos >> 12));
+}
+
+typedef int (*ReadFunc)(void* ctx, uint8_t* buf, int size);
+
+struct SyncReader {
+	int fd;
+	int64_t pos;
+	static int read(void* ctx, uint8_t* buf, int size) {
+		SyncReader* r = (SyncReader*) ctx;
+		ssize_t ret = throttledPread(r->fd, buf, size, r->pos);
+		if(ret > 0) r->pos += ret;
+		return (int) ret;
+	}
+	static void seek(void* ctx, int64_t pos) { ((SyncReader*) ctx)->pos = pos; }
+};
+
+struct AheadReader {
+	ReadAheadFile file;
+	static int read(void* ctx, uint8_t* buf, int size) {
+		return ((AheadReader*) ctx)->file.read(buf, size);
+	}
+	static void seek(void* ctx, int64_t pos) { ((AheadReader*) ctx)->file.seek(pos, SEEK_SET); }
+};
+
+// Reads len bytes from pos and checks the content.
+static bool consume(void* ctx, ReadFunc read, int64_t pos, int64_t len) {
+	uint8_t buf[kReadSize];
+	while(len > 0) {
+		int n = read(ctx, buf, kReadSize);
+		if(n <= 0) return false;
+		for(int i = 0; i < n; ++i)
+			if(buf[i] != expectedByte(pos + i)) {
+				printf("wrong data at %lli\n", (long long) (pos + i));
+				return false;
+			}
+		busyWait(kDecodeUsPer4KB * 1e-6 * n / kReadSize);
+		pos += n;
+		len -= n;
+	}
+	return true;
+}
+
+template<typename Reader>
+static void bench(const char* name, Reader& reader) {
+	double start = monotonicTime();
+	if(!consume(&reader, Reader::read, 0, kFileSize))
+		printf("%s: sequential read failed\n", name);
+	double seqTime = monotonicTime() - start;
+
+	srand(42);
+	start = monotonicTime();
+	for(int i = 0; i < kNumSeeks; ++i) {
+		int64_t pos = rand() % (kFileSize - 256 * 1024);
+		Reader::seek(&reader, pos);
+		if(!consume(&reader, Reader::read, pos, 256 * 1024))
+			printf("%s: read after seek failed\n", name);
+	}
+	double seekTime = monotonicTime() - start;
+
+	printf("%s: sequential %.2f s (%.1f MB/s), %i seeks + 256KB each %.2f s\n",
+		   name, seqTime, kFileSize / seqTime / 1e6, kNumSeeks, seekTime);
+}
+
+int main() {
+	char filename[] = "/tmp/readahead-bench-XXXXXX";
+	int fd = mkstemp(filename);
+	if(fd < 0) { perror("mkstemp"); return 1; }
+	{
+		std::vector<uint8_t> data(kFileSize);
+		for(size_t i = 0; i < kFileSize; ++i) data[i] = expectedByte(i);
+		if(write(fd, &data[0], kFileSize) != (ssize_t) kFileSize) { perror("write"); return 1; }
+	}
+
+	printf("file %i MB, latency %i ms per request, %.0f MB/s, decode %i us per 4KB\n",
+		   int(kFileSize / 1024 / 1024), kLatencyUs / 1000, kBandwidth / 1e6, kDecodeUsPer4KB);
+
+	SyncReader sync;
+	sync.fd = fd;
+	sync.pos = 0;
+	bench("sync 4KB reads", sync);
+
+	AheadReader ahead;
+	if(!ahead.file.open(filename, throttledPread)) { printf("open failed\n"); return 1; }
+	bench("read-ahead", ahead);
+	printf("read-ahead: %llu blocks read, %llu waits, %llu invalidations\n",
+		   (unsigned long long) ahead.file.blocksRead,
+		   (unsigned long long) ahead.file.readWaits,
+		   (unsigned long long) ahead.file.invalidations);
+
+	close(fd);
+	unlink(filename);
+	return 0;
+}
@@ -0,0 +1,68 @@
+// Benchmark and quality check for the Chromaprint polyphase resampler
+// (../chromaprint/resampler.cpp) for the input rates we see most.
+// The input is a mix of sines below the cutoff, so the ideal output is
+// the same mix evaluated at the output rate.
+
+// compile:
+// c++ -O2 -std=c++11 -DHAVE_CONFIG_H -I../chromaprint resampler-bench.cpp
+//   ../chromaprint/resampler.cpp
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include "resampler.h"
+
+using namespace Chromaprint;
+
+static const int kOutRate = 11025;
+static const int kSeconds = 600;
+static const int kChunkSize = 1024 * 16; // like AudioProcessor
+
+static double Signal(double t) {
+	return 8000 * sin(t * 2 * M_PI * 440.0) + 6000 * sin(t * 2 * M_PI * 2500.0);
+}
+
+int main() {
+	const int rates[] = {44100, 48000, 96000, 22050, 8000};
+	for(size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r) {
+		const int inRate = rates[r];
+		const int n = inRate * kSeconds;
+		std::vector<short> input(n);
+		for(int i = 0; i < n; ++i)
+			input[i] = (short)lrint(Signal(double(i) / inRate));
+		std::vector<short> output((size_t)kOutRate * kSeconds + kChunkSize);
+
+		Resampler resampler;
+		resampler.Init(kOutRate, inRate, 16, 0.8);
+		std::vector<short> buffer(kChunkSize);
+		int bufferOffset = 0;
+		int inputOffset = 0;
+		size_t outLen = 0;
+		clock_t start = clock();
+		while(inputOffset < n) {
+			int len = std::min(kChunkSize - bufferOffset, n - inputOffset);
+			std::copy(&input[inputOffset], &input[inputOffset] + len, &buffer[bufferOffset]);
+			inputOffset += len;
+			bufferOffset += len;
+			int consumed = 0;
+			outLen += resampler.Resample(&output[outLen], kChunkSize, &buffer[0], bufferOffset, &consumed);
+			std::copy(&buffer[consumed], &buffer[bufferOffset], &buffer[0]);
+			bufferOffset -= consumed;
+		}
+		double secs = double(clock() - start) / CLOCKS_PER_SEC;
+
+		// Skip the start, where the input is mirrored.
+		double signal = 0, noise = 0;
+		for(size_t i = 100; i < outLen; ++i) {
+			double expected = Signal(double(i) / kOutRate);
+			signal += expected * expected;
+			noise += (output[i] - expected) * (output[i] - expected);
+		}
+		printf("%6i Hz: %i taps, %i phases, %.3f sec for %i sec audio (%.0fx realtime), SNR %.1f dB\n",
+			   inRate, resampler.filter_length(), resampler.phase_count(),
+			   secs, kSeconds, kSeconds / secs, 10 * log10(signal / noise));
+	}
+	return 0;
+}
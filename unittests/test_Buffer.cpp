@@ -50,6 +50,63 @@ void test1() {
 	}
 }
 
+void test2() {
+	Buffer buf;
+
+	for(uint32_t i = 0; i < N; ++i)
+		buf.push((uint8_t*)&i, sizeof(uint32_t));
+
+	// Skip over several chunks, then continue with pop().
+	size_t c = buf.skip(1234 * sizeof(uint32_t));
+	assert(c == 1234 * sizeof(uint32_t));
+	assert(buf.size() == (N - 1234) * sizeof(uint32_t));
+	for(uint32_t i = 1234; i < 2000; ++i) {
+		uint32_t ret;
+		c = buf.pop((uint8_t*)&ret, sizeof(uint32_t));
+		assert(c == sizeof(uint32_t));
+		assert(ret == i);
+	}
+
+	// Skip more than available.
+	c = buf.skip(N * sizeof(uint32_t));
+	assert(c == (N - 2000) * sizeof(uint32_t));
+	assert(buf.empty());
+}
+
+void test3() {
+	Buffer buf;
+	buf.historyLimit = 2000 * sizeof(uint32_t);
+
+	for(uint32_t i = 0; i < N; ++i)
+		buf.push((uint8_t*)&i, sizeof(uint32_t));
+
+	buf.skip(5000 * sizeof(uint32_t), false);
+	buf.cleanup();
+	assert(buf.historySize() >= 2000 * sizeof(uint32_t));
+	assert(buf.historySize() < 2000 * sizeof(uint32_t) + BUFFER_CHUNK_SIZE);
+
+	// Rewind into the history and read it again.
+	size_t c = buf.rewind(1500 * sizeof(uint32_t));
+	assert(c == 1500 * sizeof(uint32_t));
+	assert(buf.size() == (N - 3500) * sizeof(uint32_t));
+	for(uint32_t i = 3500; i < 6000; ++i) {
+		uint32_t ret;
+		c = buf.pop((uint8_t*)&ret, sizeof(uint32_t));
+		assert(c == sizeof(uint32_t));
+		assert(ret == i);
+	}
+
+	// We can not rewind further than the history.
+	buf.cleanup();
+	c = buf.rewind(N * sizeof(uint32_t));
+	assert(c < N * sizeof(uint32_t));
+	uint32_t ret;
+	buf.pop((uint8_t*)&ret, sizeof(uint32_t));
+	assert(ret == 6000 - c / sizeof(uint32_t));
+}
+
 int main() {
 	test1();
+	test2();
+	test3();
 }
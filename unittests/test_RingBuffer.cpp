@@ -0,0 +1,80 @@
+
+#include "RingBuffer.hpp"
+
+#include <thread>
+#include <assert.h>
+#include <stdint.h>
+
+#define N 100000
+
+void test1() {
+	RingBuffer<uint32_t> ring;
+	ring.reset(100);
+	assert(ring.capacity() == 100);
+	assert(ring.size() == 0);
+
+	uint32_t data[150];
+	for(uint32_t i = 0; i < 150; ++i) data[i] = i;
+
+	// Writes only up to the capacity.
+	size_t c = ring.write(data, 150);
+	assert(c == 100);
+	assert(ring.size() == 100);
+	assert(ring.freeSpace() == 0);
+	assert(ring.write(data, 1) == 0);
+
+	// Wrap around.
+	uint32_t ret[150];
+	c = ring.read(ret, 70);
+	assert(c == 70);
+	for(uint32_t i = 0; i < 70; ++i) assert(ret[i] == i);
+	c = ring.write(data + 100, 50);
+	assert(c == 50);
+	c = ring.read(ret, 150);
+	assert(c == 80);
+	for(uint32_t i = 0; i < 80; ++i) assert(ret[i] == 70 + i);
+	assert(ring.size() == 0);
+
+	ring.write(data, 10);
+	ring.skipAll();
+	assert(ring.size() == 0);
+	assert(ring.read(ret, 1) == 0);
+}
+
+void test2() {
+	RingBuffer<uint32_t> ring;
+	ring.reset(1000);
+
+	auto producer = [&ring]() {
+		uint32_t i = 0;
+		while(i < N) {
+			uint32_t chunk[37];
+			size_t n = 0;
+			for(; n < 37 && i + n < N; ++n) chunk[n] = i + n;
+			i += ring.write(chunk, n);
+		}
+	};
+
+	auto consumer = [&ring]() {
+		uint32_t i = 0;
+		while(i < N) {
+			uint32_t chunk[53];
+			size_t c = ring.read(chunk, 53);
+			for(size_t j = 0; j < c; ++j)
+				assert(chunk[j] == i + j);
+			i += c;
+		}
+	};
+
+	for(int i = 0; i < 10; ++i) {
+		std::thread t1(producer), t2(consumer);
+		t1.join();
+		t2.join();
+		assert(ring.size() == 0);
+	}
+}
+
+int main() {
+	test1();
+	test2();
+}